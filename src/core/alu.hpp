@@ -18,14 +18,18 @@ struct ALUResult {
   uint32_t dest_tag;
 };
 
+/**
+ * @brief An unpipelined integer unit: an instruction occupies it for latency
+ * cycles and its result is broadcast in the last of them.
+ */
 class ALU {
   std::optional<ALUInstruction> current_instruction;
   std::optional<ALUResult> broadcast_result;
-  std::optional<ALUResult> next_broadcast_result;
-  bool busy;
+  uint32_t latency;
+  uint32_t cycles_remaining = 0;
 
 public:
-  ALU();
+  explicit ALU(uint32_t latency = 2);
   bool is_available() const;
   bool has_result_for_broadcast() const;
   void tick();
@@ -39,11 +43,13 @@ private:
           op) const;
 };
 
-inline ALU::ALU()
+inline ALU::ALU(uint32_t latency)
     : current_instruction(std::nullopt), broadcast_result(std::nullopt),
-      next_broadcast_result(std::nullopt), busy(false) {}
+      latency(latency) {}
 
-inline bool ALU::is_available() const { return !busy; }
+inline bool ALU::is_available() const {
+  return !current_instruction.has_value();
+}
 
 inline bool ALU::has_result_for_broadcast() const {
   return broadcast_result.has_value();
@@ -51,7 +57,7 @@ inline bool ALU::has_result_for_broadcast() const {
 
 inline void ALU::set_instruction(ALUInstruction instruction) {
   current_instruction = instruction;
-  busy = true;
+  cycles_remaining = latency;
 }
 
 inline ALUResult ALU::get_result_for_broadcast() const {
@@ -62,19 +68,16 @@ inline ALUResult ALU::get_result_for_broadcast() const {
 }
 
 inline void ALU::tick() {
-  broadcast_result = next_broadcast_result;
+  broadcast_result = std::nullopt;
 
-  if (current_instruction.has_value()) {
+  if (current_instruction.has_value() && --cycles_remaining == 0) {
     ALUResult new_result;
     new_result.result = execute(current_instruction->a, current_instruction->b,
                                 current_instruction->op);
     new_result.dest_tag = current_instruction->dest_tag;
 
-    next_broadcast_result = new_result;
+    broadcast_result = new_result;
     current_instruction = std::nullopt;
-  } else {
-    next_broadcast_result = std::nullopt;
-    busy = false;
   }
 }
 
@@ -0,0 +1,565 @@
+#ifndef CORE_CACHE_HPP
+#define CORE_CACHE_HPP
+
+#include "../utils/config.hpp"
+#include "../utils/dump.hpp"
+#include "../utils/logger.hpp"
+#include "prefetcher.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::CACHE
+
+enum class ReplacementPolicy { LRU, PLRU, Random };
+
+struct CacheConfig {
+  uint32_t size = 32 * 1024; // bytes
+  uint32_t associativity = 8;
+  uint32_t line_size = 64; // bytes
+  ReplacementPolicy replacement = ReplacementPolicy::LRU;
+  bool write_back = true;     // otherwise write-through
+  bool write_allocate = true; // allocate a line on a write miss
+  uint32_t hit_latency = 3;   // cycles
+  uint32_t miss_latency = 20; // cycles, including the lookup; only used
+                              // when there is no next level
+  uint32_t mshrs = 8;         // outstanding line fills
+
+  /**
+   * @brief Checks that the geometry describes a power-of-two set count.
+   * @throws std::invalid_argument otherwise.
+   */
+  void validate() const {
+    auto is_pow2 = [](uint32_t value) {
+      return value != 0 && (value & (value - 1)) == 0;
+    };
+    if (!is_pow2(line_size)) {
+      throw std::invalid_argument("cache line size must be a power of two");
+    }
+    if (associativity == 0 || associativity > 64) {
+      throw std::invalid_argument("cache associativity must be 1-64");
+    }
+    if (size % (line_size * associativity) != 0 ||
+        !is_pow2(size / (line_size * associativity))) {
+      throw std::invalid_argument(
+          "cache size must be a power-of-two number of sets of "
+          "associativity * line size bytes");
+    }
+    if (replacement == ReplacementPolicy::PLRU && !is_pow2(associativity)) {
+      throw std::invalid_argument("PLRU needs a power-of-two associativity");
+    }
+    if (hit_latency == 0 || miss_latency < hit_latency) {
+      throw std::invalid_argument(
+          "cache latencies must satisfy 0 < hit <= miss");
+    }
+    if (mshrs == 0) {
+      throw std::invalid_argument("cache needs at least one MSHR");
+    }
+  }
+};
+
+/**
+ * @brief Parses a comma-separated key=value cache description on top of base,
+ * e.g. "size=16384,assoc=4,line=32,repl=plru,write=through,alloc=no,hit=2,
+ * miss=30,mshrs=8". Sizes accept a K or M suffix.
+ * @throws std::invalid_argument on unknown keys or malformed values.
+ */
+inline CacheConfig parse_cache_config(const std::string &spec,
+                                      CacheConfig base) {
+  parse_config_options(spec, [&](const std::string &key,
+                                  const std::string &value) {
+    if (key == "size") {
+      base.size = parse_config_number(key, value);
+    } else if (key == "assoc") {
+      base.associativity = parse_config_number(key, value);
+    } else if (key == "line") {
+      base.line_size = parse_config_number(key, value);
+    } else if (key == "hit") {
+      base.hit_latency = parse_config_number(key, value);
+    } else if (key == "miss") {
+      base.miss_latency = parse_config_number(key, value);
+    } else if (key == "mshrs") {
+      base.mshrs = parse_config_number(key, value);
+    } else if (key == "repl") {
+      if (value == "lru") {
+        base.replacement = ReplacementPolicy::LRU;
+      } else if (value == "plru") {
+        base.replacement = ReplacementPolicy::PLRU;
+      } else if (value == "random") {
+        base.replacement = ReplacementPolicy::Random;
+      } else {
+        throw std::invalid_argument("unknown replacement policy: " + value);
+      }
+    } else if (key == "write") {
+      if (value != "back" && value != "through") {
+        throw std::invalid_argument("write must be back or through");
+      }
+      base.write_back = value == "back";
+    } else if (key == "alloc") {
+      if (value != "yes" && value != "no") {
+        throw std::invalid_argument("alloc must be yes or no");
+      }
+      base.write_allocate = value == "yes";
+    } else {
+      throw std::invalid_argument("unknown cache option: " + key);
+    }
+  });
+  base.validate();
+  return base;
+}
+
+struct CacheStats {
+  uint64_t read_hits = 0;
+  uint64_t read_misses = 0;
+  uint64_t write_hits = 0;
+  uint64_t write_misses = 0;
+  uint64_t evictions = 0;
+  uint64_t writebacks = 0;  // dirty lines written back on eviction
+  uint64_t mshr_merges = 0; // misses to a line already being filled
+  uint64_t mshr_waits = 0;  // primary misses that found every MSHR busy
+  uint64_t mshr_wait_cycles = 0;
+  uint64_t mshr_occupancy = 0; // busy MSHRs summed over cycles
+  uint32_t mshr_peak = 0;
+  uint64_t cycles = 0;
+  uint64_t prefetches = 0;       // prefetch fills started
+  uint64_t prefetch_useful = 0;  // prefetched lines later used by a demand
+  uint64_t prefetch_late = 0;    // ... that were still being filled
+  uint64_t prefetch_unused = 0;  // prefetched lines evicted unused
+  uint64_t prefetch_dropped = 0; // requests dropped for lack of an MSHR
+};
+
+/**
+ * @brief Services a line-sized read or write that missed in (or was written
+ * through / back from) the level above.
+ * @return The cycles the next level takes to complete the request.
+ */
+using NextLevel = std::function<uint32_t(uint32_t address, bool is_write)>;
+
+/**
+ * @brief Timing model of a set-associative cache.
+ *
+ * Only tags and per-line state are tracked; data always lives in Memory. An
+ * access updates the tag array and returns how many cycles it takes. Without
+ * a next level a miss costs the fixed miss_latency; with one it costs the
+ * lookup plus the next level's latency for the line. Writebacks and
+ * write-through traffic update the next level but are assumed to be buffered
+ * off the critical path.
+ *
+ * Line fills are tracked in miss status holding registers, so the cache is
+ * non-blocking: misses to different lines overlap, and an access to a line
+ * whose fill is still in flight merges with it and completes with the fill.
+ * A miss that finds every MSHR busy waits for the earliest one to free up.
+ * The tag is installed when the miss is taken. tick() advances the cache's
+ * notion of the current cycle.
+ *
+ * An optional prefetcher observes demand accesses. Its requests fill lines
+ * through free MSHRs only, so they never delay demand misses.
+ */
+class Cache {
+  struct Line {
+    uint32_t tag = 0;
+    bool valid = false;
+    bool dirty = false;
+    bool prefetched = false; // filled by a prefetch, not yet used
+    uint64_t last_use = 0;   // LRU timestamp
+  };
+
+  CacheConfig config;
+  uint32_t set_count;
+  uint32_t offset_bits;
+  uint32_t index_bits;
+  std::vector<Line> lines;        // set_count * associativity
+  std::vector<uint8_t> plru_bits; // set_count * (associativity - 1)
+  uint64_t use_counter = 0;
+  uint32_t random_state = 0x2545F491;
+  CacheStats stats;
+  NextLevel next_level;
+
+  struct MSHR {
+    uint32_t line_address = 0;
+    uint64_t ready_cycle = 0; // free once cycle reaches this
+  };
+  std::vector<MSHR> mshrs;
+  uint64_t cycle = 0;
+
+  std::unique_ptr<Prefetcher> prefetcher;
+  std::vector<uint32_t> prefetch_requests;
+
+public:
+  explicit Cache(const CacheConfig &config);
+
+  uint32_t access(uint32_t address, uint32_t size, bool is_write,
+                  uint32_t pc = 0);
+  bool contains(uint32_t address) const;
+  void set_next_level(NextLevel next) { next_level = std::move(next); }
+  void set_prefetcher(std::unique_ptr<Prefetcher> next_prefetcher) {
+    prefetcher = std::move(next_prefetcher);
+  }
+  void tick();
+
+  const CacheConfig &get_config() const { return config; }
+  const CacheStats &get_stats() const { return stats; }
+  void print_stats(std::ostream &os, const std::string &name) const;
+
+private:
+  uint32_t access_line(uint32_t line_address, bool is_write, bool &trigger);
+  uint32_t miss_penalty(uint32_t line_address, bool is_write);
+  uint32_t allocate_mshr(uint32_t line_address);
+  void prefetch_line(uint32_t line_address);
+  void evict(uint32_t set, Line &victim);
+  uint32_t choose_victim(uint32_t set);
+  void touch(uint32_t set, uint32_t way);
+};
+
+inline Cache::Cache(const CacheConfig &config) : config(config) {
+  config.validate();
+  set_count = config.size / (config.line_size * config.associativity);
+  offset_bits = __builtin_ctz(config.line_size);
+  index_bits = __builtin_ctz(set_count);
+  lines.resize(static_cast<size_t>(set_count) * config.associativity);
+  plru_bits.resize(static_cast<size_t>(set_count) *
+                   (config.associativity - 1));
+  mshrs.resize(config.mshrs);
+}
+
+/**
+ * @brief Advances to the next cycle and samples MSHR occupancy.
+ */
+inline void Cache::tick() {
+  cycle++;
+  uint32_t busy = 0;
+  for (const MSHR &mshr : mshrs) {
+    busy += mshr.ready_cycle > cycle;
+  }
+  stats.cycles++;
+  stats.mshr_occupancy += busy;
+  stats.mshr_peak = std::max(stats.mshr_peak, busy);
+}
+
+/**
+ * @brief Performs a read or write of size bytes starting at address.
+ * @param pc Address of the instruction making the access, for prefetching.
+ * @return The access latency in cycles; an access spanning two lines takes
+ * as long as the slower one.
+ */
+inline uint32_t Cache::access(uint32_t address, uint32_t size, bool is_write,
+                              uint32_t pc) {
+  uint32_t first = address >> offset_bits;
+  uint32_t last = (address + size - 1) >> offset_bits;
+  bool trigger = false;
+  uint32_t latency = access_line(first, is_write, trigger);
+  if (last != first) {
+    latency = std::max(latency, access_line(last, is_write, trigger));
+  }
+
+  if (prefetcher) {
+    prefetch_requests.clear();
+    prefetcher->observe(pc, address, trigger, prefetch_requests);
+    for (uint32_t request : prefetch_requests) {
+      prefetch_line(request >> offset_bits);
+    }
+  }
+  return latency;
+}
+
+inline bool Cache::contains(uint32_t address) const {
+  uint32_t line_address = address >> offset_bits;
+  uint32_t set = line_address & (set_count - 1);
+  uint32_t tag = line_address >> index_bits;
+  for (uint32_t way = 0; way < config.associativity; way++) {
+    const Line &line = lines[set * config.associativity + way];
+    if (line.valid && line.tag == tag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Performs a demand access to one line.
+ * @param trigger Set if the access missed or was the first use of a
+ * prefetched line.
+ */
+inline uint32_t Cache::access_line(uint32_t line_address, bool is_write,
+                                   bool &trigger) {
+  uint32_t set = line_address & (set_count - 1);
+  uint32_t tag = line_address >> index_bits;
+  Line *ways = &lines[set * config.associativity];
+
+  for (uint32_t way = 0; way < config.associativity; way++) {
+    if (ways[way].valid && ways[way].tag == tag) {
+      touch(set, way);
+      if (is_write) {
+        ways[way].dirty = config.write_back;
+        if (!config.write_back && next_level) {
+          next_level(line_address << offset_bits, true);
+        }
+      }
+      bool was_prefetched = ways[way].prefetched;
+      if (was_prefetched) {
+        ways[way].prefetched = false;
+        stats.prefetch_useful++;
+        trigger = true;
+      }
+      // A line whose fill is still in flight is a secondary miss.
+      for (const MSHR &mshr : mshrs) {
+        if (mshr.line_address == line_address && mshr.ready_cycle > cycle) {
+          if (was_prefetched) {
+            stats.prefetch_late++;
+          }
+          stats.mshr_merges++;
+          if (is_write) {
+            stats.write_misses++;
+          } else {
+            stats.read_misses++;
+          }
+          return std::max<uint32_t>(config.hit_latency,
+                                    mshr.ready_cycle - cycle);
+        }
+      }
+      if (is_write) {
+        stats.write_hits++;
+      } else {
+        stats.read_hits++;
+      }
+      return config.hit_latency;
+    }
+  }
+
+  trigger = true;
+  if (is_write) {
+    stats.write_misses++;
+    if (!config.write_allocate) {
+      return miss_penalty(line_address, true);
+    }
+  } else {
+    stats.read_misses++;
+  }
+
+  uint32_t way = choose_victim(set);
+  Line &victim = ways[way];
+  evict(set, victim);
+  victim.tag = tag;
+  victim.valid = true;
+  victim.dirty = is_write && config.write_back;
+  victim.prefetched = false;
+  touch(set, way);
+  uint32_t latency = allocate_mshr(line_address);
+  if (is_write && !config.write_back && next_level) {
+    next_level(line_address << offset_bits, true);
+  }
+  return latency;
+}
+
+/**
+ * @brief Brings line_address in ahead of demand if it is not cached yet and
+ * an MSHR is free.
+ */
+inline void Cache::prefetch_line(uint32_t line_address) {
+  uint32_t set = line_address & (set_count - 1);
+  uint32_t tag = line_address >> index_bits;
+  Line *ways = &lines[set * config.associativity];
+  for (uint32_t way = 0; way < config.associativity; way++) {
+    if (ways[way].valid && ways[way].tag == tag) {
+      return;
+    }
+  }
+
+  MSHR *free_mshr = nullptr;
+  for (MSHR &mshr : mshrs) {
+    if (mshr.ready_cycle <= cycle) {
+      free_mshr = &mshr;
+      break;
+    }
+  }
+  if (!free_mshr) {
+    stats.prefetch_dropped++;
+    return;
+  }
+
+  uint32_t way = choose_victim(set);
+  Line &victim = ways[way];
+  evict(set, victim);
+  victim.tag = tag;
+  victim.valid = true;
+  victim.dirty = false;
+  victim.prefetched = true;
+  touch(set, way);
+  stats.prefetches++;
+  free_mshr->line_address = line_address;
+  free_mshr->ready_cycle = cycle + miss_penalty(line_address, false);
+}
+
+/**
+ * @brief Writes back victim if it is dirty before its way is reused.
+ */
+inline void Cache::evict(uint32_t set, Line &victim) {
+  if (!victim.valid) {
+    return;
+  }
+  stats.evictions++;
+  uint32_t victim_address = ((victim.tag << index_bits) | set) << offset_bits;
+  if (victim.dirty) {
+    stats.writebacks++;
+    if (next_level) {
+      next_level(victim_address, true);
+    }
+  }
+  if (victim.prefetched) {
+    stats.prefetch_unused++;
+  }
+  LOG_DEBUG("Cache evicted line {}", norb::hex(victim_address));
+}
+
+/**
+ * @brief Starts the fill of line_address in the MSHR that frees up first.
+ * @return Cycles until the fill completes, including any wait for the MSHR.
+ */
+inline uint32_t Cache::allocate_mshr(uint32_t line_address) {
+  MSHR *free_mshr = &mshrs[0];
+  for (MSHR &mshr : mshrs) {
+    if (mshr.ready_cycle < free_mshr->ready_cycle) {
+      free_mshr = &mshr;
+    }
+  }
+  uint32_t wait = 0;
+  if (free_mshr->ready_cycle > cycle) {
+    wait = static_cast<uint32_t>(free_mshr->ready_cycle - cycle);
+    stats.mshr_waits++;
+    stats.mshr_wait_cycles += wait;
+  }
+  uint32_t latency = wait + miss_penalty(line_address, false);
+  free_mshr->line_address = line_address;
+  free_mshr->ready_cycle = cycle + latency;
+  return latency;
+}
+
+/**
+ * @brief Latency of a miss on line_address, fetched from (or, for a
+ * non-allocating write, sent to) the next level.
+ */
+inline uint32_t Cache::miss_penalty(uint32_t line_address, bool is_write) {
+  if (!next_level) {
+    return config.miss_latency;
+  }
+  return config.hit_latency + next_level(line_address << offset_bits, is_write);
+}
+
+/**
+ * @brief Picks the way to fill in set: an invalid way if there is one,
+ * otherwise the one the replacement policy selects.
+ */
+inline uint32_t Cache::choose_victim(uint32_t set) {
+  const Line *ways = &lines[set * config.associativity];
+  for (uint32_t way = 0; way < config.associativity; way++) {
+    if (!ways[way].valid) {
+      return way;
+    }
+  }
+
+  switch (config.replacement) {
+  case ReplacementPolicy::LRU: {
+    uint32_t victim = 0;
+    for (uint32_t way = 1; way < config.associativity; way++) {
+      if (ways[way].last_use < ways[victim].last_use) {
+        victim = way;
+      }
+    }
+    return victim;
+  }
+  case ReplacementPolicy::PLRU: {
+    // Follow the tree bits, which point away from recently used halves.
+    const uint8_t *bits = &plru_bits[set * (config.associativity - 1)];
+    uint32_t node = 0, way = 0;
+    for (uint32_t span = config.associativity; span > 1; span /= 2) {
+      uint32_t bit = bits[node];
+      way = (way << 1) | bit;
+      node = 2 * node + 1 + bit;
+    }
+    return way;
+  }
+  default: {
+    // xorshift32 keeps runs reproducible.
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state % config.associativity;
+  }
+  }
+}
+
+inline void Cache::touch(uint32_t set, uint32_t way) {
+  lines[set * config.associativity + way].last_use = ++use_counter;
+  if (config.replacement == ReplacementPolicy::PLRU &&
+      config.associativity > 1) {
+    uint8_t *bits = &plru_bits[set * (config.associativity - 1)];
+    uint32_t node = 0;
+    for (uint32_t span = config.associativity; span > 1; span /= 2) {
+      uint32_t bit = (way & (span - 1)) >= span / 2;
+      bits[node] = !bit;
+      node = 2 * node + 1 + bit;
+    }
+  }
+}
+
+inline void Cache::print_stats(std::ostream &os,
+                               const std::string &name) const {
+  static const char *const POLICY_NAMES[] = {"LRU", "PLRU", "random"};
+  auto line = [&](const char *label, uint64_t hits, uint64_t misses) {
+    uint64_t total = hits + misses;
+    os << "  " << std::left << std::setw(8) << label << std::right
+       << std::setw(12) << total << "  hits " << std::setw(12) << hits
+       << "  misses " << std::setw(12) << misses;
+    if (total > 0) {
+      os << "  (" << std::fixed << std::setprecision(2)
+         << 100.0 * static_cast<double>(misses) / static_cast<double>(total)
+         << "% miss)";
+    }
+    os << "\n";
+  };
+
+  os << name << ": " << config.size << " B, " << config.associativity
+     << "-way, " << config.line_size << " B lines, "
+     << POLICY_NAMES[static_cast<int>(config.replacement)] << ", "
+     << (config.write_back ? "write-back" : "write-through") << ", "
+     << (config.write_allocate ? "write-allocate" : "no-write-allocate")
+     << "\n";
+  line("reads", stats.read_hits, stats.read_misses);
+  line("writes", stats.write_hits, stats.write_misses);
+  os << "  evictions " << stats.evictions << "  writebacks "
+     << stats.writebacks << "\n";
+  os << "  MSHRs " << config.mshrs << "  avg occupancy " << std::fixed
+     << std::setprecision(2)
+     << (stats.cycles > 0 ? static_cast<double>(stats.mshr_occupancy) /
+                                static_cast<double>(stats.cycles)
+                          : 0.0)
+     << "  peak " << stats.mshr_peak << "  merges " << stats.mshr_merges
+     << "  full waits " << stats.mshr_waits << " (" << stats.mshr_wait_cycles
+     << " cycles)\n";
+  if (prefetcher) {
+    auto percent = [](uint64_t part, uint64_t total) {
+      return total > 0 ? 100.0 * static_cast<double>(part) /
+                             static_cast<double>(total)
+                       : 0.0;
+    };
+    // Timely prefetches turned would-be misses into hits; late ones still
+    // count as misses.
+    uint64_t covered = stats.prefetch_useful - stats.prefetch_late;
+    uint64_t misses = stats.read_misses + stats.write_misses;
+    os << "  prefetcher " << prefetcher->describe() << "\n"
+       << "    issued " << stats.prefetches << "  useful "
+       << stats.prefetch_useful << "  late " << stats.prefetch_late
+       << "  unused " << stats.prefetch_unused << "  dropped "
+       << stats.prefetch_dropped << "\n"
+       << "    accuracy " << percent(stats.prefetch_useful, stats.prefetches)
+       << "%  coverage " << percent(covered, covered + misses) << "%\n";
+  }
+}
+
+#endif // CORE_CACHE_HPP
@@ -0,0 +1,223 @@
+#ifndef CORE_COSIM_HPP
+#define CORE_COSIM_HPP
+
+#include "../utils/elf_loader.hpp"
+#include "../utils/exceptions.hpp"
+#include "../utils/queue.hpp"
+#include "interpreter.hpp"
+#include "memory.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Checks the commit stream of the pipeline against an Interpreter
+ * running in lockstep on a second thread.
+ *
+ * The simulator pushes every commit into a lock-free queue; the checker
+ * thread executes one instruction of the golden model per commit and
+ * compares PC, destination register and value. The first divergence is
+ * reported together with the last commits that still matched, and makes the
+ * next record() throw, so the run stops shortly after the faulty commit.
+ * PCs in the report are annotated with ELF symbols when the program has them.
+ */
+class CoSimulator {
+  static constexpr size_t QUEUE_SIZE = 1 << 16; // commits, a power of two
+  static constexpr size_t HISTORY = 16;         // matched commits reported
+  // rd of the record finish() pushes after the termination instruction.
+  static constexpr uint32_t HALT = UINT32_MAX;
+
+  struct Commit {
+    uint32_t pc;
+    uint32_t rd; // NO_REGISTER if none
+    uint32_t value;
+  };
+
+  Interpreter golden;
+  std::vector<ElfSymbol> symbols; // sorted by address, for the report
+  SPSCQueue<Commit> queue;
+  // Simulator side.
+  alignas(64) uint64_t recorded = 0;
+  uint64_t full_waits = 0;
+  // Checker side, read by the simulator only once diverged is set or the
+  // checker is joined.
+  alignas(64) std::array<InterpreterStep, HISTORY> history;
+  uint64_t checked = 0;
+  std::string mismatch;
+  alignas(64) std::atomic<bool> diverged{false};
+  std::thread checker;
+
+  void check();
+
+  // Waits while the queue is full.
+  void push(const Commit &commit) {
+    if (!queue.try_push(commit)) {
+      full_waits++;
+      do {
+        if (diverged.load(std::memory_order_acquire)) {
+          return; // the checker no longer drains the queue
+        }
+        std::this_thread::yield();
+      } while (!queue.try_push(commit));
+    }
+  }
+
+  void report(const Commit &commit, const InterpreterStep *step,
+              const char *reason);
+
+public:
+  // Starts the golden model from a copy of memory, which must already hold
+  // the program.
+  CoSimulator(const Memory &memory, uint32_t entry_point,
+              std::vector<ElfSymbol> symbols = {});
+  ~CoSimulator() { finish(); }
+
+  CoSimulator(const CoSimulator &) = delete;
+  CoSimulator &operator=(const CoSimulator &) = delete;
+
+  /**
+   * @brief Queues a committed instruction for checking.
+   * @param rd The register it wrote, if any, and the value it now holds.
+   * @throws CoSimulationMismatch once the checker has found a divergence.
+   */
+  void record(uint32_t pc, std::optional<uint32_t> rd, uint32_t value) {
+    if (diverged.load(std::memory_order_acquire)) [[unlikely]] {
+      throw CoSimulationMismatch(mismatch);
+    }
+    push(Commit{pc, rd && *rd != 0 ? *rd : NO_REGISTER, value});
+    recorded++;
+  }
+
+  /**
+   * @brief Waits for the checker to catch up after the simulator committed
+   * the termination instruction, and checks that the golden model stops
+   * there too.
+   * @return false if any commit diverged; see get_mismatch().
+   */
+  bool finish();
+
+  const std::string &get_mismatch() const { return mismatch; }
+
+  void print_stats(std::ostream &os) const {
+    os << "Co-simulation: " << recorded << " commits  queue stalls "
+       << full_waits << "\n";
+  }
+};
+
+inline CoSimulator::CoSimulator(const Memory &memory, uint32_t entry_point,
+                                std::vector<ElfSymbol> symbols)
+    : golden(memory, entry_point), symbols(std::move(symbols)),
+      queue(QUEUE_SIZE) {
+  checker = std::thread(&CoSimulator::check, this);
+}
+
+/**
+ * @brief Checker thread: replays commits on the golden model until the halt
+ * record or the first divergence, polling while the queue is empty.
+ */
+inline void CoSimulator::check() {
+  Commit commit;
+  while (true) {
+    if (!queue.try_pop(commit)) {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+      continue;
+    }
+    if (commit.rd == HALT) {
+      if (golden.next_instruction() != HALT_INSTRUCTION) {
+        report(commit, nullptr,
+               "the simulator terminated, the golden model continues");
+      }
+      return;
+    }
+    InterpreterStep step;
+    if (golden.next_instruction() == HALT_INSTRUCTION) {
+      report(commit, nullptr, "the golden model terminated here");
+      return;
+    }
+    if (!golden.step(step)) {
+      report(commit, nullptr, "the golden model cannot execute");
+      return;
+    }
+    if (step.pc != commit.pc || step.rd != commit.rd ||
+        step.value != commit.value) {
+      report(commit, &step, "commit differs");
+      return;
+    }
+    history[checked % HISTORY] = step;
+    checked++;
+  }
+}
+
+inline void CoSimulator::report(const Commit &commit,
+                                const InterpreterStep *step,
+                                const char *reason) {
+  auto hex = [](uint32_t value) {
+    std::ostringstream ss;
+    ss << "0x" << std::hex << std::setw(8) << std::setfill('0') << value;
+    return ss.str();
+  };
+  // "0x... <name+0x...>", or just the address outside every symbol.
+  auto pc_name = [&](uint32_t pc) {
+    const ElfSymbol *symbol = find_elf_symbol(symbols, pc);
+    if (!symbol) {
+      return hex(pc);
+    }
+    std::ostringstream ss;
+    ss << hex(pc) << " <" << symbol->name;
+    if (pc != symbol->address) {
+      ss << "+0x" << std::hex << pc - symbol->address;
+    }
+    ss << '>';
+    return ss.str();
+  };
+  auto destination = [&](uint32_t rd, uint32_t value) {
+    return rd == NO_REGISTER ? std::string("-")
+                             : "x" + std::to_string(rd) + " = " + hex(value);
+  };
+
+  std::ostringstream os;
+  os << "Co-simulation mismatch at commit " << checked + 1 << ": " << reason
+     << "\n";
+  if (commit.rd != HALT) {
+    os << "  simulator     pc " << pc_name(commit.pc) << "  "
+       << destination(commit.rd, commit.value) << "\n";
+  }
+  os << "  golden model  pc " << pc_name(step ? step->pc : golden.get_pc())
+     << "  instruction "
+     << hex(step ? step->instruction : golden.next_instruction());
+  if (step) {
+    os << "  " << destination(step->rd, step->value);
+  }
+  os << "\n";
+  uint64_t first = checked > HISTORY ? checked - HISTORY : 0;
+  if (first < checked) {
+    os << "Last matching commits:\n";
+  }
+  for (uint64_t i = first; i < checked; i++) {
+    const InterpreterStep &past = history[i % HISTORY];
+    os << "  " << std::setw(10) << i + 1 << "  pc " << pc_name(past.pc)
+       << "  instruction " << hex(past.instruction) << "  "
+       << destination(past.rd, past.value) << "\n";
+  }
+  mismatch = os.str();
+  diverged.store(true, std::memory_order_release);
+}
+
+inline bool CoSimulator::finish() {
+  if (checker.joinable()) {
+    push(Commit{0, HALT, 0});
+    checker.join();
+  }
+  return !diverged.load(std::memory_order_acquire);
+}
+
+#endif // CORE_COSIM_HPP
@@ -5,32 +5,116 @@
 #include "../tomasulo/reorder_buffer.hpp"
 #include "../tomasulo/reservation_station.hpp"
 #include "../utils/binary_loader.hpp"
+#include "../utils/commit_trace.hpp"
 #include "../utils/exceptions.hpp"
 #include "../utils/logger.hpp"
+#include "../utils/trace.hpp"
 #include "alu.hpp"
+#include "cache.hpp"
+#include "cosim.hpp"
+#include "decode_cache.hpp"
+#include "dram.hpp"
 #include "memory.hpp"
 #include "predictor.hpp"
 #include "register_file.hpp"
 #include "riscv/instruction.hpp"
 #include <cstdint>
+#include <deque>
+#include <iomanip>
 #include <limits>
+#include <memory>
 #include <optional>
+#include <ostream>
 #include <sstream>
 #include <variant>
 
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::CPU
+
+/**
+ * @brief Default geometry of the unified L2 cache.
+ */
+inline CacheConfig default_l2_config() {
+  CacheConfig config;
+  config.size = 256 * 1024;
+  config.hit_latency = 12;
+  config.miss_latency = 40;
+  config.mshrs = 16;
+  return config;
+}
+
+/**
+ * @brief A class of identical functional units.
+ */
+struct FunctionalUnitConfig {
+  uint32_t count = 1;
+  uint32_t latency = 2; // cycles from dispatch to result broadcast
+};
+
+struct CPUConfig {
+  bool use_image_cache = false; // reuse/write a binary image of the input
+  LSBConfig lsb;
+  // The memory hierarchy is off unless configured, keeping the baseline
+  // fixed-latency timing.
+  std::optional<CacheConfig> l1d;                 // nullopt: no L1D model
+  std::optional<PrefetcherConfig> l1d_prefetcher; // nullopt: no prefetching
+  std::optional<CacheConfig> l1i;                 // nullopt: no L1I model
+  std::optional<CacheConfig> l2;                  // nullopt: no L2
+  std::optional<DRAMConfig> dram; // nullopt: fixed miss latency
+  uint32_t fetch_block_size = 16; // bytes per fetch, a power of two
+  uint32_t fetch_buffer_size = 8; // decoded instructions waiting for issue
+  uint32_t issue_width = 1;       // instructions issued per cycle
+  uint32_t commit_width = 1;      // instructions retired per cycle
+  FunctionalUnitConfig alu;       // unpipelined integer units
+  FunctionalUnitConfig branch;    // pipelined branch units
+};
+
+struct FetchedInstruction {
+  uint32_t pc;
+  PredecodedInstruction pre;
+};
+
 class CPU {
   RegisterFile reg_file;
   ReorderBuffer rob;
   ReservationStation rs;
+  Memory memory;
   BinaryLoader loader;
-  ALU alu;
+  std::vector<ALU> alus;
+  std::unique_ptr<DRAM> dram;
+  std::unique_ptr<Cache> l2;
+  std::unique_ptr<Cache> l1d;
   LSB mem;
-  Predictor pred;
-  uint32_t pc;
-
-  std::optional<riscv::DecodedInstruction> fetched_instruction;
-  uint32_t fetched_pc;
+  std::vector<Predictor> branch_units;
+  DecodeCache decode_cache;
+  std::unique_ptr<Cache> l1i;
+  uint32_t pc; // next instruction to issue
+  uint64_t cycle_count = 0;
+
+  // Fetch unit: delivers one aligned block per cycle into fetch_buffer,
+  // running ahead of issue along the sequential path from fetch_pc.
+  std::deque<FetchedInstruction> fetch_buffer;
+  uint32_t fetch_pc;
+  uint32_t fetch_block_size;
+  uint32_t fetch_buffer_size;
+  uint32_t fetch_miss_cycles = 0; // remaining I-cache miss stall
+  uint64_t fetched_blocks = 0;
+  uint64_t fetch_stall_cycles = 0;
+  uint32_t issue_width;
+  uint32_t commit_width;
+  uint64_t issued_count = 0; // including instructions flushed later
+  FunctionalUnitConfig alu_config;
+  FunctionalUnitConfig branch_config;
+  uint64_t alu_dispatches = 0;
+  uint64_t branch_dispatches = 0;
+  // Cycles ready instructions waited because every unit of their class was
+  // busy, summed over the instructions.
+  uint64_t alu_unit_stalls = 0;
+  uint64_t branch_unit_stalls = 0;
   bool stall_fetch;
+  TraceWriter *tracer = nullptr; // optional pipeline event trace
+  CommitTraceWriter *commit_trace = nullptr; // optional commit trace
+  CoSimulator *cosim = nullptr; // optional golden model check
 
   // Helper function for hex formatting
   std::string to_hex(uint32_t value) const {
@@ -40,13 +124,31 @@ class CPU {
   }
 
 public:
-  CPU(std::string filename);
-  CPU();
+  CPU(std::string filename, const CPUConfig &config = {});
+  explicit CPU(const CPUConfig &config = {});
   int run();
+  void print_stats(std::ostream &os) const;
+  void set_tracer(TraceWriter *writer);
+  void set_commit_trace(CommitTraceWriter *writer);
+  void set_cosim(CoSimulator *checker);
+  // The loaded program, before run() changes it.
+  const Memory &get_memory() const { return memory; }
+  uint32_t get_entry_point() const { return loader.get_entry_point(); }
+  const std::vector<ElfSymbol> &get_symbols() const {
+    return loader.get_symbols();
+  }
 
 private:
-  riscv::DecodedInstruction fetch();
-  void issue(riscv::DecodedInstruction instr);
+  void connect_memory_hierarchy(const CPUConfig &config);
+  PredecodedInstruction fetch(uint32_t address);
+  void fetch_block();
+  void redirect_fetch();
+  void invalidate_fetch_buffer(uint32_t address, uint32_t size);
+  void issue_group();
+  bool issue(const PredecodedInstruction &pre);
+  void trace_broadcast(uint32_t rob_id, uint32_t value, TraceUnit unit);
+  ALU *free_alu();
+  Predictor *free_branch_unit();
   void dispatch();
   void commit();
   void Tick();
@@ -55,40 +157,145 @@ private:
                                 uint32_t current_pc);
 };
 
-inline CPU::CPU(std::string filename)
-    : reg_file(), rob(reg_file, alu, pred, mem, rs), rs(), loader(filename),
-      pc(0), fetched_instruction(std::nullopt), fetched_pc(0),
+inline CPU::CPU(std::string filename, const CPUConfig &config)
+    : reg_file(), rob(reg_file, branch_units, mem, rs, config.commit_width),
+      rs(), memory(),
+      loader(memory, filename, config.use_image_cache),
+      alus(config.alu.count, ALU(config.alu.latency)),
+      dram(config.dram ? std::make_unique<DRAM>(*config.dram) : nullptr),
+      l2(config.l2 ? std::make_unique<Cache>(*config.l2) : nullptr),
+      l1d(config.l1d ? std::make_unique<Cache>(*config.l1d) : nullptr),
+      mem(memory, config.lsb, l1d.get()),
+      branch_units(config.branch.count, Predictor(config.branch.latency)),
+      l1i(config.l1i ? std::make_unique<Cache>(*config.l1i) : nullptr),
+      pc(loader.get_entry_point()), fetch_pc(pc),
+      fetch_block_size(config.fetch_block_size),
+      fetch_buffer_size(config.fetch_buffer_size),
+      issue_width(config.issue_width), commit_width(config.commit_width),
+      alu_config(config.alu), branch_config(config.branch),
       stall_fetch(false) {
-  LOG_INFO("CPU initialized with binary file: " + filename);
+  LOG_INFO("CPU initialized with binary file: {}", filename);
 
-  mem.get_memory().initialize_from_loader(loader.get_memory());
+  memory.set_store_observer([this](uint32_t address, uint32_t size) {
+    decode_cache.invalidate(address, size);
+    invalidate_fetch_buffer(address, size);
+  });
+  connect_memory_hierarchy(config);
 
-  LOG_DEBUG("Initial PC: 0x" + std::to_string(pc));
+  LOG_DEBUG("Initial PC: {}", to_hex(pc));
 }
 
-inline CPU::CPU()
-    : reg_file(), rob(reg_file, alu, pred, mem, rs), rs(), loader(), pc(0),
-      fetched_instruction(std::nullopt), fetched_pc(0), stall_fetch(false) {
+inline CPU::CPU(const CPUConfig &config)
+    : reg_file(), rob(reg_file, branch_units, mem, rs, config.commit_width),
+      rs(), memory(),
+      loader(memory),
+      alus(config.alu.count, ALU(config.alu.latency)),
+      dram(config.dram ? std::make_unique<DRAM>(*config.dram) : nullptr),
+      l2(config.l2 ? std::make_unique<Cache>(*config.l2) : nullptr),
+      l1d(config.l1d ? std::make_unique<Cache>(*config.l1d) : nullptr),
+      mem(memory, config.lsb, l1d.get()),
+      branch_units(config.branch.count, Predictor(config.branch.latency)),
+      l1i(config.l1i ? std::make_unique<Cache>(*config.l1i) : nullptr), pc(0),
+      fetch_pc(0), fetch_block_size(config.fetch_block_size),
+      fetch_buffer_size(config.fetch_buffer_size),
+      issue_width(config.issue_width), commit_width(config.commit_width),
+      alu_config(config.alu), branch_config(config.branch),
+      stall_fetch(false) {
   LOG_INFO("CPU initializing with binary data from stdin");
 
   // Load data from stdin
   loader.load_from_stdin();
+  pc = loader.get_entry_point();
+  fetch_pc = pc;
+
+  memory.set_store_observer([this](uint32_t address, uint32_t size) {
+    decode_cache.invalidate(address, size);
+    invalidate_fetch_buffer(address, size);
+  });
+  connect_memory_hierarchy(config);
+
+  LOG_DEBUG("Initial PC: {}", to_hex(pc));
+}
 
-  mem.get_memory().initialize_from_loader(loader.get_memory());
+/**
+ * @brief Routes L1 misses to the L2, and L2 misses to DRAM. A missing level
+ * is skipped; the last level present falls back to its fixed miss latency.
+ * Also attaches the configured prefetcher to the L1D.
+ */
+inline void CPU::connect_memory_hierarchy(const CPUConfig &config) {
+  NextLevel dram_level;
+  if (dram) {
+    dram_level = [this](uint32_t address, bool is_write) {
+      return dram->access(address, is_write);
+    };
+  }
+  if (l2) {
+    l2->set_next_level(dram_level);
+  }
+  for (Cache *l1 : {l1i.get(), l1d.get()}) {
+    if (!l1) {
+      continue;
+    }
+    if (l2) {
+      // Requests cover a whole L1 line, which may span several L2 lines.
+      const uint32_t line_size = l1->get_config().line_size;
+      l1->set_next_level([this, line_size](uint32_t address, bool is_write) {
+        return l2->access(address, line_size, is_write);
+      });
+    } else {
+      l1->set_next_level(dram_level);
+    }
+  }
+  if (l1d && config.l1d_prefetcher) {
+    l1d->set_prefetcher(make_prefetcher(*config.l1d_prefetcher,
+                                        l1d->get_config().line_size));
+  }
+}
+
+/**
+ * @brief Records pipeline events of the following cycles into writer, which
+ * must outlive the run. nullptr stops tracing.
+ */
+inline void CPU::set_tracer(TraceWriter *writer) {
+  tracer = writer;
+  rob.set_tracer(writer);
+  mem.set_tracer(writer);
+}
+
+/**
+ * @brief Records the architectural state after every commit of the following
+ * cycles into writer, which must outlive the run. nullptr stops recording.
+ */
+inline void CPU::set_commit_trace(CommitTraceWriter *writer) {
+  commit_trace = writer;
+  rob.set_commit_trace(writer);
+}
 
-  LOG_DEBUG("Initial PC: 0x" + std::to_string(pc));
+/**
+ * @brief Checks every commit of the following cycles against checker, which
+ * must outlive the run. nullptr stops checking.
+ * @note run() then throws CoSimulationMismatch shortly after the first
+ * commit that differs from the golden model.
+ */
+inline void CPU::set_cosim(CoSimulator *checker) {
+  cosim = checker;
+  rob.set_cosim(checker);
 }
 
 inline int CPU::run() {
   LOG_INFO("Starting CPU execution loop");
-  int cycle_count = 0;
+  cycle_count = 0;
 
   try {
     while (true) {
       cycle_count++;
-      LOG_DEBUG("======================= Cycle " + std::to_string(cycle_count) +
-                " =======================");
-      LOG_DEBUG("PC: " + to_hex(pc) + " (decimal: " + std::to_string(pc) + ")");
+      Logger::setCycle(cycle_count);
+      if (tracer) {
+        tracer->set_cycle(cycle_count);
+      }
+      LOG_DEBUG("======================= Cycle {} =======================",
+                cycle_count);
+      LOG_DEBUG("PC: {} (decimal: {})", to_hex(pc), pc);
 
       Tick();
 
@@ -98,39 +305,109 @@ inline int CPU::run() {
       }
     }
   } catch (const ProgramTerminationException &e) {
-    LOG_INFO("Program terminated normally: " + std::string(e.what()));
+    LOG_INFO("Program terminated normally: {}", e.what());
     int exit_code = e.get_exit_code();
-    LOG_INFO("Final exit code: " + std::to_string(exit_code));
+    LOG_INFO("Final exit code: {}", exit_code);
     return exit_code;
   }
 }
 
+/**
+ * @brief Writes cycle, instruction and cache counters of the last run.
+ */
+inline void CPU::print_stats(std::ostream &os) const {
+  uint64_t instructions = rob.get_committed_count();
+  os << "cycles        " << cycle_count << "\n"
+     << "instructions  " << instructions << "\n";
+  if (cycle_count > 0) {
+    os << "IPC           " << std::fixed << std::setprecision(3)
+       << static_cast<double>(instructions) / static_cast<double>(cycle_count)
+       << "\n";
+  }
+  os << "fetch blocks  " << fetched_blocks << "  I-cache stall cycles "
+     << fetch_stall_cycles << "\n";
+  os << "issued        " << issued_count << "  issue width " << issue_width
+     << "  commit width " << commit_width << "\n";
+  os << "ALUs          " << alu_config.count << " x " << alu_config.latency
+     << " cycles  dispatched " << alu_dispatches << "  waited for a unit "
+     << alu_unit_stalls << "\n"
+     << "branch units  " << branch_config.count << " x "
+     << branch_config.latency << " cycles  dispatched " << branch_dispatches
+     << "  waited for a unit " << branch_unit_stalls << "\n";
+  mem.print_stats(os);
+  if (l1i) {
+    l1i->print_stats(os, "L1I");
+  }
+  if (l1d) {
+    l1d->print_stats(os, "L1D");
+  }
+  if (l2) {
+    l2->print_stats(os, "L2");
+  }
+  if (dram) {
+    dram->print_stats(os);
+  }
+  if (tracer) {
+    tracer->print_stats(os);
+  }
+  if (commit_trace) {
+    commit_trace->print_stats(os);
+  }
+  if (cosim) {
+    cosim->print_stats(os);
+  }
+}
+
 inline void CPU::Tick() {
   LOG_DEBUG("======================= Beginning parallel cycle "
             "=======================");
 
-  alu.tick();
-  if (mem.has_result_for_broadcast()) {
-    MemoryResult mem_result = mem.get_result_for_broadcast();
+  for (Cache *cache : {l1i.get(), l1d.get(), l2.get()}) {
+    if (cache) {
+      cache->tick();
+    }
+  }
+  for (ALU &alu : alus) {
+    alu.tick();
+  }
+  for (const MemoryResult &mem_result : mem.get_results_for_broadcast()) {
     if (mem_result.is_load()) {
+      trace_broadcast(mem_result.rob_id, mem_result.data, TraceUnit::Memory);
       rob.receive_memory_result(mem_result);
       rs.receive_broadcast(mem_result.data, mem_result.dest_tag);
+      mem.receive_broadcast(mem_result.data, mem_result.dest_tag);
     }
   }
 
-  pred.tick();
-  if (alu.has_result_for_broadcast()) {
+  for (Predictor &unit : branch_units) {
+    unit.tick();
+  }
+  // Every unit drives its own result bus.
+  for (const ALU &alu : alus) {
+    if (!alu.has_result_for_broadcast()) {
+      continue;
+    }
     ALUResult alu_result = alu.get_result_for_broadcast();
+    trace_broadcast(alu_result.dest_tag, alu_result.result, TraceUnit::ALU);
     rob.receive_alu_result(alu_result);
     rs.receive_broadcast(alu_result.result, alu_result.dest_tag);
+    mem.receive_broadcast(alu_result.result, alu_result.dest_tag);
   }
 
   mem.tick();
-  if (pred.has_result_for_broadcast()) {
-    PredictorResult pred_result = pred.get_result_for_broadcast();
+  for (const Predictor &unit : branch_units) {
+    if (!unit.has_result_for_broadcast()) {
+      continue;
+    }
+    PredictorResult pred_result = unit.get_result_for_broadcast();
+    trace_broadcast(pred_result.rob_id, pred_result.return_address,
+                    TraceUnit::Branch);
     rob.receive_predictor_result(pred_result);
     if (pred_result.dest_tag.has_value()) {
-      rs.receive_broadcast(pred_result.pc, pred_result.dest_tag.value());
+      rs.receive_broadcast(pred_result.return_address,
+                           pred_result.dest_tag.value());
+      mem.receive_broadcast(pred_result.return_address,
+                            pred_result.dest_tag.value());
     }
   }
 
@@ -139,95 +416,203 @@ inline void CPU::Tick() {
   LOG_DEBUG("--- Commit Stage ---");
   commit();
 
-  if (!stall_fetch && !rob.isFull()) {
+  if (stall_fetch) {
+    LOG_DEBUG("--- Fetch Stage stalled (branch misprediction recovery) ---");
+  } else {
     LOG_DEBUG("--- Fetch Stage ---");
-    try {
-      if (!fetched_instruction.has_value()) {
-        fetched_pc = pc;
-        riscv::DecodedInstruction instr = fetch();
-        fetched_instruction = instr;
-        LOG_INFO("Fetched instruction from pc: " + to_hex(fetched_pc));
-      }
+    fetch_block();
 
-      if (fetched_instruction.has_value()) {
-        LOG_DEBUG("--- Issue Stage ---");
-        issue(fetched_instruction.value());
-        fetched_instruction = std::nullopt;
-      }
-    } catch (const std::exception &e) {
-      LOG_WARN("Fetch/Issue stage exception: " + std::string(e.what()));
-      pc = fetched_pc;
-      fetched_instruction = std::nullopt;
-    }
-  } else {
     if (rob.isFull()) {
-      LOG_DEBUG("--- Fetch Stage stalled (ROB full) ---");
-    } else if (stall_fetch) {
-      LOG_DEBUG("--- Fetch Stage stalled (branch misprediction recovery) ---");
+      LOG_DEBUG("--- Issue Stage stalled (ROB full) ---");
+    } else if (!fetch_buffer.empty()) {
+      LOG_DEBUG("--- Issue Stage ---");
+      issue_group();
     }
   }
 
   stall_fetch = false;
 }
 
-inline riscv::DecodedInstruction CPU::fetch() {
-  LOG_DEBUG("Fetching instruction from PC: " + to_hex(pc) +
-            " (decimal: " + std::to_string(pc) + ")");
+/**
+ * @brief Fetch stage: brings the aligned block holding fetch_pc into the
+ * fetch buffer, from fetch_pc up to the end of the block.
+ *
+ * A block is only fetched when the buffer has room for all of it. An I-cache
+ * miss stalls the fetch unit for the extra miss latency before the block is
+ * delivered. Fetch stops early at an address that cannot be fetched and
+ * retries it on the next cycle.
+ */
+inline void CPU::fetch_block() {
+  if (fetch_miss_cycles > 0) {
+    fetch_stall_cycles++;
+    if (--fetch_miss_cycles > 0) {
+      return;
+    }
+  } else {
+    if (fetch_buffer.size() + fetch_block_size / 4 > fetch_buffer_size) {
+      return;
+    }
+    if (l1i) {
+      uint32_t latency =
+          l1i->access(fetch_pc & ~(fetch_block_size - 1), fetch_block_size,
+                      false);
+      if (latency > l1i->get_config().hit_latency) {
+        fetch_miss_cycles = latency - l1i->get_config().hit_latency;
+        LOG_DEBUG("I-cache miss at {}, stalling {} cycles", to_hex(fetch_pc),
+                  fetch_miss_cycles);
+        return;
+      }
+    }
+  }
+
+  fetched_blocks++;
+  uint32_t block_end = (fetch_pc & ~(fetch_block_size - 1)) + fetch_block_size;
+  try {
+    while (fetch_pc < block_end || (block_end == 0 && fetch_pc != 0)) {
+      fetch_buffer.push_back({fetch_pc, fetch(fetch_pc)});
+      if (tracer) {
+        tracer->record(TraceEvent::Fetch, TRACE_NO_ROB, fetch_pc);
+      }
+      fetch_pc += 4;
+    }
+  } catch (const std::exception &e) {
+    LOG_WARN("Fetch stage exception: {}", e.what());
+  }
+}
+
+/**
+ * @brief Discards the fetch buffer and restarts fetching at pc.
+ */
+inline void CPU::redirect_fetch() {
+  if (tracer) {
+    tracer->record(TraceEvent::Redirect, TRACE_NO_ROB, pc,
+                   static_cast<uint32_t>(fetch_buffer.size()));
+  }
+  fetch_buffer.clear();
+  fetch_pc = pc;
+  fetch_miss_cycles = 0;
+}
 
-  uint32_t instr = loader.fetchInstruction(pc);
-  LOG_DEBUG("Raw instruction: 0x" + std::to_string(instr));
+/**
+ * @brief Drops buffered instructions a store has just overwritten, together
+ * with everything fetched after them.
+ */
+inline void CPU::invalidate_fetch_buffer(uint32_t address, uint32_t size) {
+  for (size_t i = 0; i < fetch_buffer.size(); i++) {
+    uint32_t instruction_pc = fetch_buffer[i].pc;
+    if (instruction_pc - address < size || address - instruction_pc < 4) {
+      fetch_pc = instruction_pc;
+      if (tracer) {
+        tracer->record(TraceEvent::Redirect, TRACE_NO_ROB, fetch_pc,
+                       static_cast<uint32_t>(fetch_buffer.size() - i));
+      }
+      fetch_buffer.erase(fetch_buffer.begin() + i, fetch_buffer.end());
+      fetch_miss_cycles = 0;
+      return;
+    }
+  }
+}
 
-  riscv::DecodedInstruction decoded_instr = riscv::decode(instr);
-  pc += 4;
+inline PredecodedInstruction CPU::fetch(uint32_t address) {
+  LOG_DEBUG("Fetching instruction from PC: {} (decimal: {})", to_hex(address),
+            address);
+
+  // Misaligned PCs bypass the cache, which only tracks whole words.
+  const PredecodedInstruction *cached =
+      (address & 3) == 0 ? decode_cache.lookup(address) : nullptr;
+  PredecodedInstruction pre;
+  if (cached) {
+    LOG_DEBUG("Decode cache hit");
+    pre = *cached;
+  } else {
+    uint32_t instr = loader.fetchInstruction(address);
+    LOG_DEBUG("Raw instruction: {}", to_hex(instr));
+    pre = predecode(instr);
+    if ((address & 3) == 0) {
+      decode_cache.insert(address, pre);
+    }
+  }
+  return pre;
+}
 
-  LOG_DEBUG("Instruction fetched and decoded, PC updated to: " + to_hex(pc));
-  return decoded_instr;
+/**
+ * @brief Issue stage: issues up to issue_width instructions from the front
+ * of the fetch buffer, in program order.
+ *
+ * Each instruction is renamed before the next one reads its sources, so
+ * dependencies within the group resolve to the ROB tags just allocated. The
+ * group ends early at the first instruction that finds the ROB, the
+ * reservation stations or the LSB full, and after a predicted-taken branch
+ * or jump, which redirects fetch.
+ */
+inline void CPU::issue_group() {
+  for (uint32_t slot = 0; slot < issue_width && !fetch_buffer.empty();
+       slot++) {
+    uint32_t next_pc = fetch_buffer.front().pc + 4;
+    pc = next_pc;
+    try {
+      if (!issue(fetch_buffer.front().pre)) {
+        return;
+      }
+    } catch (const std::exception &e) {
+      LOG_WARN("Issue stage exception: {}", e.what());
+      pc = next_pc - 4;
+      return;
+    }
+    fetch_buffer.pop_front();
+    issued_count++;
+    // A predicted-taken branch or jump changed the issue path.
+    if (pc != next_pc) {
+      redirect_fetch();
+      return;
+    }
+  }
 }
 
-inline void CPU::issue(riscv::DecodedInstruction instr) {
+/**
+ * @brief Issues one instruction into the ROB and a reservation station or
+ * the LSB. pc must be the instruction's address + 4 on entry; it is updated
+ * to the predicted next instruction.
+ * @return false if the instruction could not be issued this cycle.
+ */
+inline bool CPU::issue(const PredecodedInstruction &pre) {
+  const riscv::DecodedInstruction &instr = pre.instr;
   if (std::holds_alternative<std::monostate>(instr)) {
     LOG_ERROR("Attempting to issue invalid instruction");
     throw std::runtime_error("Invalid instruction");
   }
 
-  LOG_DEBUG("Issuing instruction");
+  LOG_DEBUG("Issuing instruction: {}", riscv::to_string(instr));
 
-  std::optional<uint32_t> rd, rs1, rs2;
-  std::optional<int32_t> imm;
+  const std::optional<uint32_t> &rd = pre.rd, &rs1 = pre.rs1, &rs2 = pre.rs2;
+  const std::optional<int32_t> &imm = pre.imm;
 
-  if (auto *r_instr = std::get_if<riscv::R_Instruction>(&instr)) {
-    LOG_DEBUG("R-type instruction detected");
-    rd = r_instr->rd;
-    rs1 = r_instr->rs1;
-    rs2 = r_instr->rs2;
+  // Loads and stores go straight into the load/store queue.
+  std::optional<std::variant<riscv::I_LoadOp, riscv::S_StoreOp>> memory_op;
+  if (auto *s_instr = std::get_if<riscv::S_Instruction>(&instr)) {
+    memory_op = s_instr->op;
   } else if (auto *i_instr = std::get_if<riscv::I_Instruction>(&instr)) {
-    LOG_DEBUG("I-type instruction detected");
-    rd = i_instr->rd;
-    rs1 = i_instr->rs1;
-    imm = i_instr->imm;
-  } else if (auto *s_instr = std::get_if<riscv::S_Instruction>(&instr)) {
-    LOG_DEBUG("S-type instruction detected");
-    rs1 = s_instr->rs1;
-    rs2 = s_instr->rs2;
-    imm = s_instr->imm;
-  } else if (auto *b_instr = std::get_if<riscv::B_Instruction>(&instr)) {
-    LOG_DEBUG("B-type instruction detected");
-    rs1 = b_instr->rs1;
-    rs2 = b_instr->rs2;
-    imm = b_instr->imm;
-  } else if (auto *u_instr = std::get_if<riscv::U_Instruction>(&instr)) {
-    LOG_DEBUG("U-type instruction detected");
-    rd = u_instr->rd;
-    imm = u_instr->imm;
-  } else if (auto *j_instr = std::get_if<riscv::J_Instruction>(&instr)) {
-    LOG_DEBUG("J-type instruction detected");
-    rd = j_instr->rd;
-    imm = j_instr->imm;
-    LOG_DEBUG("J-type immediate value: " + std::to_string(imm.value()));
+    if (auto *load_op = std::get_if<riscv::I_LoadOp>(&i_instr->op)) {
+      memory_op = *load_op;
+    }
+  }
+  if (memory_op.has_value() && mem.is_full()) {
+    LOG_DEBUG("LSB is full, instruction not issued, rolling back PC");
+    pc -= 4;
+    return false;
+  }
+  if (!memory_op.has_value() && rs.is_full()) {
+    LOG_DEBUG("Reservation stations are full, instruction not issued, "
+              "rolling back PC");
+    pc -= 4;
+    return false;
   }
 
   int id = rob.add_entry(instr, rd, pc - 4);
   if (id != -1) {
+    if (tracer) {
+      tracer->record(TraceEvent::Issue, id, pc - 4);
+    }
     int32_t vj = 0, vk = 0;
     uint32_t qj = std::numeric_limits<uint32_t>::max(),
              qk = std::numeric_limits<uint32_t>::max();
@@ -236,19 +621,18 @@ inline void CPU::issue(riscv::DecodedInstruction instr) {
       uint32_t rob_tag = reg_file.get_rob(rs1.value());
       if (rob_tag == std::numeric_limits<uint32_t>::max()) {
         vj = reg_file.read(rs1.value());
-        LOG_DEBUG("Source operand 1 (rs1) is ready: reg" +
-                  std::to_string(rs1.value()) + " = " + std::to_string(vj));
+        LOG_DEBUG("Source operand 1 (rs1) is ready: reg{} = {}", rs1.value(),
+                  vj);
       } else {
         qj = rob_tag;
-        LOG_DEBUG("Source operand 1 (rs1) is waiting for ROB tag: " +
-                  std::to_string(qj));
+        LOG_DEBUG("Source operand 1 (rs1) is waiting for ROB tag: {}", qj);
         // check ROB
         auto rob_value = rob.get_value(rob_tag);
         if (rob_value.has_value()) {
           vj = rob_value.value();
           qj = std::numeric_limits<uint32_t>::max(); // Clear qj since we have
                                                      // the value
-          LOG_DEBUG("Resolved ROB value for rs1: " + std::to_string(vj));
+          LOG_DEBUG("Resolved ROB value for rs1: {}", vj);
         }
       }
     }
@@ -258,58 +642,109 @@ inline void CPU::issue(riscv::DecodedInstruction instr) {
       if (rob_tag ==
           std::numeric_limits<uint32_t>::max()) { // Register is ready
         vk = reg_file.read(rs2.value());
-        LOG_DEBUG("Source operand 2 (rs2) is ready: reg" +
-                  std::to_string(rs2.value()) + " = " + std::to_string(vk));
+        LOG_DEBUG("Source operand 2 (rs2) is ready: reg{} = {}", rs2.value(),
+                  vk);
       } else {
         qk = rob_tag;
-        LOG_DEBUG("Source operand 2 (rs2) is waiting for ROB tag: " +
-                  std::to_string(qk));
+        LOG_DEBUG("Source operand 2 (rs2) is waiting for ROB tag: {}", qk);
         auto rob_value = rob.get_value(rob_tag);
         if (rob_value.has_value()) {
           vk = rob_value.value();
           qk = std::numeric_limits<uint32_t>::max();
-          LOG_DEBUG("Resolved ROB value for rs2: " + std::to_string(vk));
+          LOG_DEBUG("Resolved ROB value for rs2: {}", vk);
         }
       }
     } else {
       vk = imm.value_or(0);
-      LOG_DEBUG("Source operand 2 is an immediate value: " +
-                std::to_string(vk));
+      LOG_DEBUG("Source operand 2 is an immediate value: {}", vk);
     }
 
-    rs.add_entry(instr, vj, vk, qj, qk, imm, id, pc - 4);
-    LOG_DEBUG("Added entry to Reservation Station");
+    if (memory_op.has_value()) {
+      LSBInstruction instruction;
+      instruction.op_type = memory_op.value();
+      instruction.address = vj;
+      instruction.address_tag = qj;
+      instruction.imm = imm.value_or(0);
+      instruction.dest_tag = id;
+      instruction.rob_id = id;
+      instruction.pc = pc - 4;
+      if (rs2.has_value()) {
+        instruction.data = vk;
+        instruction.data_tag = qk;
+      } else {
+        instruction.data = 0;
+      }
+      mem.add_instruction(instruction);
+      LOG_DEBUG("Added entry to Load/Store Buffer");
+    } else {
+      rs.add_entry(instr, vj, vk, qj, qk, imm, id, pc - 4);
+      LOG_DEBUG("Added entry to Reservation Station");
+    }
 
     // check prediction instruction
     // B
     if (std::holds_alternative<riscv::B_Instruction>(instr)) {
       pc += std::get<riscv::B_Instruction>(instr).imm;
       pc -= 4; // because we already incremented PC in fetch
-      LOG_DEBUG("Branch instruction, updated PC to: " + to_hex(pc));
+      LOG_DEBUG("Branch instruction, updated PC to: {}", to_hex(pc));
     } else if (std::holds_alternative<riscv::J_Instruction>(instr)) {
       // JAL
       pc += std::get<riscv::J_Instruction>(instr).imm;
       pc -= 4; // because we already incremented PC in fetch
-      LOG_DEBUG("JAL instruction, updated PC to: " + to_hex(pc));
+      LOG_DEBUG("JAL instruction, updated PC to: {}", to_hex(pc));
     } else if (std::holds_alternative<riscv::I_Instruction>(instr) &&
                std::holds_alternative<riscv::I_JumpOp>(
                    std::get<riscv::I_Instruction>(instr).op)) {
       // JALR
       // do nothing
-      LOG_DEBUG("JALR instruction, updated PC to: " + to_hex(pc));
+      LOG_DEBUG("JALR instruction, updated PC to: {}", to_hex(pc));
     }
 
     if (rd.has_value()) {
       reg_file.receive_rob(rd.value(), id);
-      LOG_DEBUG("Marked register " + std::to_string(rd.value()) +
-                " as busy with ROB ID: " + std::to_string(id));
+      LOG_DEBUG("Marked register {} as busy with ROB ID: {}", rd.value(), id);
+    }
+    return true;
+  }
+  LOG_WARN("ROB is full, instruction not issued, rolling back PC");
+  pc -= 4;
+  return false;
+}
+
+/**
+ * @brief Records a result broadcast on the CDB, tagged with the PC of the
+ * producing instruction.
+ */
+inline void CPU::trace_broadcast(uint32_t rob_id, uint32_t value,
+                                 TraceUnit unit) {
+  if (tracer) {
+    tracer->record(TraceEvent::Broadcast, rob_id,
+                   rob.get_pc(rob_id).value_or(0), value, unit);
+  }
+}
+
+inline ALU *CPU::free_alu() {
+  for (ALU &alu : alus) {
+    if (alu.is_available()) {
+      return &alu;
+    }
+  }
+  return nullptr;
+}
+
+inline Predictor *CPU::free_branch_unit() {
+  for (Predictor &unit : branch_units) {
+    if (unit.is_available()) {
+      return &unit;
     }
-  } else {
-    LOG_WARN("ROB is full, instruction not issued, rolling back PC");
-    pc -= 4;
   }
+  return nullptr;
 }
 
+/**
+ * @brief Dispatch stage: starts every reservation station entry whose
+ * operands are ready on a free unit of its class, in station order.
+ */
 inline void CPU::dispatch() {
   LOG_DEBUG("Scanning reservation stations for ready instructions");
   int dispatched_count = 0;
@@ -320,88 +755,57 @@ inline void CPU::dispatch() {
     // Skip if operands not ready
     if (ent.qj != std::numeric_limits<uint32_t>::max() ||
         ent.qk != std::numeric_limits<uint32_t>::max()) {
-      LOG_DEBUG("RS entry " + std::to_string(i) + " waiting for operands (qj=" +
-                std::to_string(ent.qj) + ", qk=" + std::to_string(ent.qk) +
-                ") with instruction: " + riscv::to_string(ent.op));
-      // I_LoadOp, S_instruction
-      if (std::holds_alternative<riscv::S_Instruction>(ent.op)) {
-        LSBInstruction instruction;
-        instruction.op_type = std::get<riscv::S_Instruction>(ent.op).op;
-        instruction.address = ent.vj;
-        instruction.data = ent.vk;
-        instruction.imm = ent.imm;
-        instruction.can_execute = false;
-        instruction.dest_tag = ent.dest_tag;
-        instruction.rob_id = ent.dest_tag;
-        mem.add_instruction(instruction);
-      } else if (auto *i_instr = std::get_if<riscv::I_Instruction>(&ent.op)) {
-        if (std::holds_alternative<riscv::I_LoadOp>(i_instr->op)) {
-          LSBInstruction instruction;
-          instruction.op_type = std::get<riscv::I_LoadOp>(i_instr->op);
-          instruction.address = ent.vj;
-          instruction.imm = ent.imm;
-          instruction.can_execute = false;
-          instruction.dest_tag = ent.dest_tag;
-          instruction.rob_id = ent.dest_tag;
-          mem.add_instruction(instruction);
-        }
-      }
+      LOG_DEBUG("RS entry {} waiting for operands (qj={}, qk={}) with "
+                "instruction: {}",
+                i, ent.qj, ent.qk, riscv::to_string(ent.op));
       continue;
     }
 
     bool dispatched = false;
+    TraceUnit unit = TraceUnit::None;
 
     if (std::holds_alternative<riscv::R_Instruction>(ent.op)) {
       // R-type -> ALU
-      if (alu.is_available()) {
-        LOG_DEBUG("Dispatching R-type instruction to ALU (tag=" +
-                  std::to_string(ent.dest_tag) + ")");
+      if (ALU *alu = free_alu()) {
+        LOG_DEBUG("Dispatching R-type instruction to ALU (tag={})",
+                  ent.dest_tag);
         ALUInstruction instruction;
         instruction.a = ent.vj;
         instruction.b = ent.vk;
         instruction.op = std::get<riscv::R_Instruction>(ent.op).op;
         instruction.dest_tag = ent.dest_tag;
-        alu.set_instruction(instruction);
+        alu->set_instruction(instruction);
         dispatched = true;
+        unit = TraceUnit::ALU;
       } else {
-        LOG_DEBUG("ALU busy, cannot dispatch R-type instruction");
+        LOG_DEBUG("All ALUs busy, cannot dispatch R-type instruction");
+        alu_unit_stalls++;
       }
     } else if (auto *i_instr = std::get_if<riscv::I_Instruction>(&ent.op)) {
       // I-type -> check operation subtype
-      if (std::holds_alternative<riscv::I_LoadOp>(i_instr->op)) {
-        // Load -> Memory unit
-        LOG_DEBUG("Dispatching I-type load instruction to memory unit (tag=" +
-                  std::to_string(ent.dest_tag) +
-                  ", rob_id=" + std::to_string(ent.dest_tag) + ")");
-        LSBInstruction instruction;
-        instruction.op_type = std::get<riscv::I_LoadOp>(i_instr->op);
-        instruction.address = ent.vj;
-        instruction.imm = ent.imm;
-        instruction.can_execute = true;
-        instruction.dest_tag = ent.dest_tag;
-        instruction.rob_id = ent.dest_tag;
-        mem.add_instruction(instruction);
-        dispatched = true;
-      } else if (std::holds_alternative<riscv::I_ArithmeticOp>(i_instr->op)) {
+      if (std::holds_alternative<riscv::I_ArithmeticOp>(i_instr->op)) {
         // Arithmetic -> ALU
-        if (alu.is_available()) {
-          LOG_DEBUG("Dispatching I-type arithmetic instruction to ALU (tag=" +
-                    std::to_string(ent.dest_tag) + ")");
+        if (ALU *alu = free_alu()) {
+          LOG_DEBUG("Dispatching I-type arithmetic instruction to ALU (tag={})",
+                    ent.dest_tag);
           ALUInstruction instruction;
           instruction.a = ent.vj;
           instruction.b = ent.vk;
           instruction.op = std::get<riscv::I_ArithmeticOp>(i_instr->op);
           instruction.dest_tag = ent.dest_tag;
-          alu.set_instruction(instruction);
+          alu->set_instruction(instruction);
           dispatched = true;
+          unit = TraceUnit::ALU;
         } else {
-          LOG_DEBUG("ALU busy, cannot dispatch I-type arithmetic instruction");
+          LOG_DEBUG(
+              "All ALUs busy, cannot dispatch I-type arithmetic instruction");
+          alu_unit_stalls++;
         }
       } else if (std::holds_alternative<riscv::I_JumpOp>(i_instr->op)) {
         // Jump -> Predictor
-        if (pred.is_available()) {
-          LOG_DEBUG("Dispatching I-type jump instruction to predictor (tag=" +
-                    std::to_string(ent.dest_tag) + ")");
+        if (Predictor *pred = free_branch_unit()) {
+          LOG_DEBUG("Dispatching I-type jump instruction to predictor (tag={})",
+                    ent.dest_tag);
           PredictorInstruction instruction;
           instruction.pc = ent.pc;
           instruction.rs1 = ent.vj;
@@ -410,33 +814,21 @@ inline void CPU::dispatch() {
           instruction.imm = ent.imm;
           instruction.rob_id = ent.dest_tag;
           instruction.branch_type = std::get<riscv::I_JumpOp>(i_instr->op);
-          LOG_DEBUG("JALR: rs1_val=" + std::to_string(instruction.rs1) +
-                    ", imm=" + std::to_string(instruction.imm));
-          pred.set_instruction(instruction);
+          LOG_DEBUG("JALR: rs1_val={}, imm={}", instruction.rs1,
+                    instruction.imm);
+          pred->set_instruction(instruction);
           dispatched = true;
+          unit = TraceUnit::Branch;
         } else {
-          LOG_DEBUG("Predictor busy, cannot dispatch jump instruction");
+          LOG_DEBUG("All branch units busy, cannot dispatch jump instruction");
+          branch_unit_stalls++;
         }
       }
-    } else if (std::holds_alternative<riscv::S_Instruction>(ent.op)) {
-      // Store -> Memory unit
-      LOG_DEBUG("Dispatching S-type store instruction to memory unit (tag=" +
-                std::to_string(ent.dest_tag) + ")");
-      LSBInstruction instruction;
-      instruction.op_type = std::get<riscv::S_Instruction>(ent.op).op;
-      instruction.address = ent.vj;
-      instruction.data = ent.vk;
-      instruction.imm = ent.imm;
-      instruction.can_execute = true;
-      instruction.dest_tag = ent.dest_tag;
-      instruction.rob_id = ent.dest_tag;
-      mem.add_instruction(instruction);
-      dispatched = true;
     } else if (std::holds_alternative<riscv::B_Instruction>(ent.op)) {
       // Branch -> Predictor
-      if (pred.is_available()) {
-        LOG_DEBUG("Dispatching B-type branch instruction to predictor (tag=" +
-                  std::to_string(ent.dest_tag) + ")");
+      if (Predictor *pred = free_branch_unit()) {
+        LOG_DEBUG("Dispatching B-type branch instruction to predictor (tag={})",
+                  ent.dest_tag);
         PredictorInstruction instruction;
         instruction.pc = ent.pc;
         instruction.rs1 = ent.vj;
@@ -445,31 +837,35 @@ inline void CPU::dispatch() {
         instruction.imm = ent.imm;
         instruction.rob_id = ent.dest_tag;
         instruction.branch_type = std::get<riscv::B_Instruction>(ent.op).op;
-        pred.set_instruction(instruction);
+        pred->set_instruction(instruction);
         dispatched = true;
+        unit = TraceUnit::Branch;
       } else {
-        LOG_DEBUG("Predictor busy, cannot dispatch branch instruction");
+        LOG_DEBUG("All branch units busy, cannot dispatch branch instruction");
+        branch_unit_stalls++;
       }
     } else if (std::holds_alternative<riscv::U_Instruction>(ent.op)) {
       // U-type -> ALU
-      if (alu.is_available()) {
-        LOG_DEBUG("Dispatching U-type instruction to ALU (tag=" +
-                  std::to_string(ent.dest_tag) + ")");
+      if (ALU *alu = free_alu()) {
+        LOG_DEBUG("Dispatching U-type instruction to ALU (tag={})",
+                  ent.dest_tag);
         ALUInstruction instruction;
         instruction.a = ent.vj;
         instruction.b = ent.vk;
         instruction.op = std::get<riscv::U_Instruction>(ent.op).op;
         instruction.dest_tag = ent.dest_tag;
-        alu.set_instruction(instruction);
+        alu->set_instruction(instruction);
         dispatched = true;
+        unit = TraceUnit::ALU;
       } else {
-        LOG_DEBUG("ALU busy, cannot dispatch U-type instruction");
+        LOG_DEBUG("All ALUs busy, cannot dispatch U-type instruction");
+        alu_unit_stalls++;
       }
     } else if (std::holds_alternative<riscv::J_Instruction>(ent.op)) {
       // Jump -> Predictor
-      if (pred.is_available()) {
-        LOG_DEBUG("Dispatching J-type jump instruction to predictor (tag=" +
-                  std::to_string(ent.dest_tag) + ")");
+      if (Predictor *pred = free_branch_unit()) {
+        LOG_DEBUG("Dispatching J-type jump instruction to predictor (tag={})",
+                  ent.dest_tag);
         PredictorInstruction instruction;
         instruction.pc = ent.pc;
         instruction.rs1 = 0;
@@ -478,16 +874,26 @@ inline void CPU::dispatch() {
         instruction.rob_id = ent.dest_tag;
         instruction.imm = ent.imm;
         instruction.branch_type = std::get<riscv::J_Instruction>(ent.op).op;
-        LOG_DEBUG("JAL: pc=" + std::to_string(instruction.pc) +
-                  ", imm=" + std::to_string(instruction.imm));
-        pred.set_instruction(instruction);
+        LOG_DEBUG("JAL: pc={}, imm={}", instruction.pc, instruction.imm);
+        pred->set_instruction(instruction);
         dispatched = true;
+        unit = TraceUnit::Branch;
       } else {
-        LOG_DEBUG("Predictor busy, cannot dispatch J-type jump instruction");
+        LOG_DEBUG(
+            "All branch units busy, cannot dispatch J-type jump instruction");
+        branch_unit_stalls++;
       }
     }
 
     if (dispatched) {
+      if (unit == TraceUnit::ALU) {
+        alu_dispatches++;
+      } else {
+        branch_dispatches++;
+      }
+      if (tracer) {
+        tracer->record(TraceEvent::Dispatch, ent.dest_tag, ent.pc, 0, unit);
+      }
       LOG_DEBUG("Removing dispatched instruction from reservation station");
       rs.rs.remove(i);
       i--;
@@ -495,8 +901,7 @@ inline void CPU::dispatch() {
     }
   }
 
-  LOG_DEBUG("Dispatched " + std::to_string(dispatched_count) +
-            " instructions in this cycle");
+  LOG_DEBUG("Dispatched {} instructions in this cycle", dispatched_count);
 }
 
 inline void CPU::commit() {
@@ -508,7 +913,7 @@ inline void CPU::commit() {
   if (mispredicted) {
     LOG_DEBUG("Branch misprediction detected, stalling fetch for next cycle");
     stall_fetch = true;
-    fetched_instruction = std::nullopt;
+    redirect_fetch();
   }
 
   // rob.print_debug_info();
@@ -0,0 +1,129 @@
+#ifndef CORE_DECODE_CACHE_HPP
+#define CORE_DECODE_CACHE_HPP
+
+#include "../riscv/decoder.hpp"
+#include "../riscv/instruction.hpp"
+#include "../utils/logger.hpp"
+#include <cstdint>
+#include <optional>
+#include <variant>
+#include <vector>
+
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::DECODE
+
+/**
+ * @brief A decoded instruction together with the operand fields issue needs.
+ */
+struct PredecodedInstruction {
+  riscv::DecodedInstruction instr;
+  std::optional<uint32_t> rd, rs1, rs2;
+  std::optional<int32_t> imm;
+};
+
+/**
+ * @brief Decodes a raw instruction word and extracts its operand fields.
+ */
+inline PredecodedInstruction predecode(uint32_t raw) {
+  PredecodedInstruction pre;
+  pre.instr = riscv::decode(raw);
+
+  if (auto *r_instr = std::get_if<riscv::R_Instruction>(&pre.instr)) {
+    pre.rd = r_instr->rd;
+    pre.rs1 = r_instr->rs1;
+    pre.rs2 = r_instr->rs2;
+  } else if (auto *i_instr = std::get_if<riscv::I_Instruction>(&pre.instr)) {
+    pre.rd = i_instr->rd;
+    pre.rs1 = i_instr->rs1;
+    pre.imm = i_instr->imm;
+  } else if (auto *s_instr = std::get_if<riscv::S_Instruction>(&pre.instr)) {
+    pre.rs1 = s_instr->rs1;
+    pre.rs2 = s_instr->rs2;
+    pre.imm = s_instr->imm;
+  } else if (auto *b_instr = std::get_if<riscv::B_Instruction>(&pre.instr)) {
+    pre.rs1 = b_instr->rs1;
+    pre.rs2 = b_instr->rs2;
+    pre.imm = b_instr->imm;
+  } else if (auto *u_instr = std::get_if<riscv::U_Instruction>(&pre.instr)) {
+    pre.rd = u_instr->rd;
+    pre.imm = u_instr->imm;
+  } else if (auto *j_instr = std::get_if<riscv::J_Instruction>(&pre.instr)) {
+    pre.rd = j_instr->rd;
+    pre.imm = j_instr->imm;
+  }
+  return pre;
+}
+
+constexpr size_t DECODE_CACHE_SIZE = 4096;
+
+/**
+ * @brief Direct-mapped cache of predecoded instructions indexed by PC.
+ *
+ * Stores to guest memory must be reported through invalidate() so that
+ * self-modifying code never executes a stale decode.
+ */
+class DecodeCache {
+  struct Entry {
+    uint32_t pc;
+    bool valid = false;
+    PredecodedInstruction pre;
+  };
+
+  std::vector<Entry> entries;
+
+  static size_t index_of(uint32_t pc) {
+    return (pc >> 2) & (DECODE_CACHE_SIZE - 1);
+  }
+
+public:
+  DecodeCache() : entries(DECODE_CACHE_SIZE) {}
+
+  /**
+   * @brief Looks up the predecoded instruction at pc.
+   * @return The cached entry, or nullptr on a miss.
+   */
+  const PredecodedInstruction *lookup(uint32_t pc) const {
+    const Entry &entry = entries[index_of(pc)];
+    return (entry.valid && entry.pc == pc) ? &entry.pre : nullptr;
+  }
+
+  /**
+   * @brief Caches a predecoded instruction for pc, evicting any conflict.
+   */
+  const PredecodedInstruction &insert(uint32_t pc,
+                                      const PredecodedInstruction &pre) {
+    Entry &entry = entries[index_of(pc)];
+    entry.pc = pc;
+    entry.valid = true;
+    entry.pre = pre;
+    return entry.pre;
+  }
+
+  /**
+   * @brief Drops cached decodes of every instruction word a store touches.
+   * @param address The first byte written.
+   * @param size The number of bytes written.
+   */
+  void invalidate(uint32_t address, uint32_t size) {
+    uint32_t first = address & ~3U;
+    uint32_t last = (address + size - 1) & ~3U;
+    for (uint32_t pc = first;; pc += 4) {
+      Entry &entry = entries[index_of(pc)];
+      if (entry.valid && entry.pc == pc) {
+        entry.valid = false;
+        LOG_DEBUG("Invalidated decoded instruction at pc {}", pc);
+      }
+      if (pc == last) {
+        break;
+      }
+    }
+  }
+
+  void clear() {
+    for (auto &entry : entries) {
+      entry.valid = false;
+    }
+  }
+};
+
+#endif // CORE_DECODE_CACHE_HPP
@@ -0,0 +1,150 @@
+#ifndef CORE_DRAM_HPP
+#define CORE_DRAM_HPP
+
+#include "../utils/config.hpp"
+#include "../utils/logger.hpp"
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::DRAM
+
+struct DRAMConfig {
+  uint32_t banks = 8;
+  uint32_t row_size = 2048;         // bytes per row in each bank
+  uint32_t t_rcd = 42;              // activate to column command, cycles
+  uint32_t t_cas = 42;              // column command to data, cycles
+  uint32_t t_rp = 42;               // precharge, cycles
+  uint32_t controller_latency = 30; // queueing and bus transfer, cycles
+
+  /**
+   * @brief Checks that banks and rows are powers of two.
+   * @throws std::invalid_argument otherwise.
+   */
+  void validate() const {
+    auto is_pow2 = [](uint32_t value) {
+      return value != 0 && (value & (value - 1)) == 0;
+    };
+    if (!is_pow2(banks)) {
+      throw std::invalid_argument("DRAM bank count must be a power of two");
+    }
+    if (!is_pow2(row_size)) {
+      throw std::invalid_argument("DRAM row size must be a power of two");
+    }
+    if (t_cas == 0) {
+      throw std::invalid_argument("DRAM tCAS must be positive");
+    }
+  }
+};
+
+/**
+ * @brief Parses a comma-separated key=value DRAM description on top of base,
+ * e.g. "banks=8,row=2K,trcd=42,tcas=42,trp=42,ctrl=30".
+ * @throws std::invalid_argument on unknown keys or malformed values.
+ */
+inline DRAMConfig parse_dram_config(const std::string &spec,
+                                    DRAMConfig base) {
+  parse_config_options(spec, [&](const std::string &key,
+                                  const std::string &value) {
+    if (key == "banks") {
+      base.banks = parse_config_number(key, value);
+    } else if (key == "row") {
+      base.row_size = parse_config_number(key, value);
+    } else if (key == "trcd") {
+      base.t_rcd = parse_config_number(key, value);
+    } else if (key == "tcas") {
+      base.t_cas = parse_config_number(key, value);
+    } else if (key == "trp") {
+      base.t_rp = parse_config_number(key, value);
+    } else if (key == "ctrl") {
+      base.controller_latency = parse_config_number(key, value);
+    } else {
+      throw std::invalid_argument("unknown DRAM option: " + key);
+    }
+  });
+  base.validate();
+  return base;
+}
+
+struct DRAMStats {
+  uint64_t reads = 0;
+  uint64_t writes = 0;
+  uint64_t row_hits = 0;      // row already open in the bank
+  uint64_t row_empty = 0;     // bank had no open row
+  uint64_t row_conflicts = 0; // another row had to be closed first
+};
+
+/**
+ * @brief Timing model of DRAM banks with an open-page policy.
+ *
+ * Consecutive rows are interleaved across banks. Each bank keeps its last row
+ * open, so an access costs tCAS on a row hit, tRCD + tCAS on an idle bank and
+ * tRP + tRCD + tCAS on a row conflict, plus the controller latency.
+ */
+class DRAM {
+  static constexpr uint32_t NO_ROW = UINT32_MAX;
+
+  DRAMConfig config;
+  uint32_t row_bits;
+  std::vector<uint32_t> open_rows; // per bank
+  DRAMStats stats;
+
+public:
+  explicit DRAM(const DRAMConfig &config);
+
+  uint32_t access(uint32_t address, bool is_write);
+
+  const DRAMConfig &get_config() const { return config; }
+  const DRAMStats &get_stats() const { return stats; }
+  void print_stats(std::ostream &os) const;
+};
+
+inline DRAM::DRAM(const DRAMConfig &config)
+    : config(config), open_rows(config.banks, NO_ROW) {
+  config.validate();
+  row_bits = __builtin_ctz(config.row_size);
+}
+
+/**
+ * @brief Reads or writes the line at address.
+ * @return The access latency in cycles.
+ */
+inline uint32_t DRAM::access(uint32_t address, bool is_write) {
+  uint32_t global_row = address >> row_bits;
+  uint32_t bank = global_row & (config.banks - 1);
+  uint32_t row = global_row / config.banks;
+  if (is_write) {
+    stats.writes++;
+  } else {
+    stats.reads++;
+  }
+
+  uint32_t latency = config.controller_latency + config.t_cas;
+  uint32_t &open_row = open_rows[bank];
+  if (open_row == row) {
+    stats.row_hits++;
+  } else if (open_row == NO_ROW) {
+    stats.row_empty++;
+    latency += config.t_rcd;
+  } else {
+    stats.row_conflicts++;
+    latency += config.t_rp + config.t_rcd;
+  }
+  open_row = row;
+  LOG_DEBUG("DRAM access to bank {}, row {}: {} cycles", bank, row, latency);
+  return latency;
+}
+
+inline void DRAM::print_stats(std::ostream &os) const {
+  os << "DRAM: " << config.banks << " banks, " << config.row_size
+     << " B rows, tRCD " << config.t_rcd << ", tCAS " << config.t_cas
+     << ", tRP " << config.t_rp << "\n";
+  os << "  reads " << stats.reads << "  writes " << stats.writes << "\n";
+  os << "  row hits " << stats.row_hits << "  row empty " << stats.row_empty
+     << "  row conflicts " << stats.row_conflicts << "\n";
+}
+
+#endif // CORE_DRAM_HPP
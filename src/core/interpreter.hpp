@@ -0,0 +1,252 @@
+#ifndef CORE_INTERPRETER_HPP
+#define CORE_INTERPRETER_HPP
+
+#include "memory.hpp"
+#include <array>
+#include <cstdint>
+
+// The termination instruction, li a0, 255 (addi a0, x0, 255).
+constexpr uint32_t HALT_INSTRUCTION = 0x0ff00513;
+constexpr uint32_t NO_REGISTER = 32;
+
+struct InterpreterStep {
+  uint32_t pc;
+  uint32_t instruction;
+  uint32_t rd; // NO_REGISTER if no register other than x0 was written
+  uint32_t value;
+};
+
+/**
+ * @brief Functional RV32I model: executes one instruction per step straight
+ * from the raw encoding, with no timing.
+ *
+ * Decodes independently of riscv::decode() so that it can serve as a golden
+ * model for the pipeline, decoder included.
+ */
+class Interpreter {
+  Memory memory;
+  std::array<uint32_t, 32> regs{};
+  uint32_t pc;
+
+public:
+  // Starts from a private copy of image.
+  Interpreter(const Memory &image, uint32_t entry_point);
+
+  uint32_t get_pc() const { return pc; }
+  uint32_t read_register(uint32_t reg) const { return regs[reg]; }
+  // The instruction the next step() executes.
+  uint32_t next_instruction() const { return memory.read(pc); }
+
+  /**
+   * @brief Executes the instruction at pc.
+   * @return false, leaving the state unchanged, if it is not a valid RV32I
+   * instruction the simulator implements.
+   */
+  bool step(InterpreterStep &result);
+};
+
+inline Interpreter::Interpreter(const Memory &image, uint32_t entry_point)
+    : pc(entry_point) {
+  memory.copy_from(image);
+}
+
+inline bool Interpreter::step(InterpreterStep &result) {
+  uint32_t inst = static_cast<uint32_t>(memory.read(pc));
+  uint32_t opcode = inst & 0x7F;
+  uint32_t rd = (inst >> 7) & 0x1F;
+  uint32_t funct3 = (inst >> 12) & 0x7;
+  uint32_t rs1 = (inst >> 15) & 0x1F;
+  uint32_t rs2 = (inst >> 20) & 0x1F;
+  uint32_t funct7 = inst >> 25;
+  uint32_t a = regs[rs1], b = regs[rs2];
+  int32_t imm_i = static_cast<int32_t>(inst) >> 20;
+  int32_t imm_s = (static_cast<int32_t>(inst) >> 25 << 5) | rd;
+  int32_t imm_b = (static_cast<int32_t>(inst) >> 31 << 12) |
+                  ((inst << 4) & 0x800) | ((inst >> 20) & 0x7E0) |
+                  ((inst >> 7) & 0x1E);
+  int32_t imm_j = (static_cast<int32_t>(inst) >> 31 << 20) | (inst & 0xFF000) |
+                  ((inst >> 9) & 0x800) | ((inst >> 20) & 0x7FE);
+
+  uint32_t next_pc = pc + 4;
+  bool writes = true;
+  uint32_t value = 0;
+  switch (opcode) {
+  case 0x37: // LUI
+    value = inst & 0xFFFFF000;
+    break;
+  case 0x17: // AUIPC
+    value = pc + (inst & 0xFFFFF000);
+    break;
+  case 0x6F: // JAL
+    value = pc + 4;
+    next_pc = pc + imm_j;
+    break;
+  case 0x67: // JALR
+    if (funct3 != 0) {
+      return false;
+    }
+    value = pc + 4;
+    next_pc = (a + imm_i) & ~1U;
+    break;
+  case 0x63: { // branches
+    bool taken;
+    switch (funct3) {
+    case 0x0:
+      taken = a == b;
+      break;
+    case 0x1:
+      taken = a != b;
+      break;
+    case 0x4:
+      taken = static_cast<int32_t>(a) < static_cast<int32_t>(b);
+      break;
+    case 0x5:
+      taken = static_cast<int32_t>(a) >= static_cast<int32_t>(b);
+      break;
+    case 0x6:
+      taken = a < b;
+      break;
+    case 0x7:
+      taken = a >= b;
+      break;
+    default:
+      return false;
+    }
+    if (taken) {
+      next_pc = pc + imm_b;
+    }
+    writes = false;
+    break;
+  }
+  case 0x03: { // loads
+    uint32_t address = a + imm_i;
+    switch (funct3) {
+    case 0x0:
+      value = static_cast<int32_t>(memory.read_byte_signed(address));
+      break;
+    case 0x1:
+      value = static_cast<int32_t>(memory.read_halfword(address));
+      break;
+    case 0x2:
+      value = static_cast<uint32_t>(memory.read(address));
+      break;
+    case 0x4:
+      value = memory.read_byte_unsigned(address);
+      break;
+    case 0x5:
+      value = memory.read_halfword_unsigned(address);
+      break;
+    default:
+      return false;
+    }
+    break;
+  }
+  case 0x23: { // stores
+    uint32_t address = a + imm_s;
+    switch (funct3) {
+    case 0x0:
+      memory.write_byte(address, static_cast<uint8_t>(b));
+      break;
+    case 0x1:
+      memory.write_halfword(address, static_cast<int16_t>(b));
+      break;
+    case 0x2:
+      memory.write(address, static_cast<int32_t>(b));
+      break;
+    default:
+      return false;
+    }
+    writes = false;
+    break;
+  }
+  case 0x13: { // register-immediate arithmetic
+    uint32_t shamt = rs2;
+    switch (funct3) {
+    case 0x0:
+      value = a + imm_i;
+      break;
+    case 0x2:
+      value = static_cast<int32_t>(a) < imm_i;
+      break;
+    case 0x3:
+      value = a < static_cast<uint32_t>(imm_i);
+      break;
+    case 0x4:
+      value = a ^ imm_i;
+      break;
+    case 0x6:
+      value = a | imm_i;
+      break;
+    case 0x7:
+      value = a & imm_i;
+      break;
+    case 0x1:
+      if (funct7 != 0x00) {
+        return false;
+      }
+      value = a << shamt;
+      break;
+    case 0x5:
+      if (funct7 == 0x00) {
+        value = a >> shamt;
+      } else if (funct7 == 0x20) {
+        value = static_cast<int32_t>(a) >> shamt;
+      } else {
+        return false;
+      }
+      break;
+    }
+    break;
+  }
+  case 0x33: { // register-register arithmetic
+    if (funct7 != 0x00 && !(funct7 == 0x20 && (funct3 == 0 || funct3 == 5))) {
+      return false;
+    }
+    switch (funct3) {
+    case 0x0:
+      value = funct7 == 0x00 ? a + b : a - b;
+      break;
+    case 0x1:
+      value = a << (b & 0x1F);
+      break;
+    case 0x2:
+      value = static_cast<int32_t>(a) < static_cast<int32_t>(b);
+      break;
+    case 0x3:
+      value = a < b;
+      break;
+    case 0x4:
+      value = a ^ b;
+      break;
+    case 0x5:
+      value = funct7 == 0x00 ? a >> (b & 0x1F)
+                             : static_cast<int32_t>(a) >> (b & 0x1F);
+      break;
+    case 0x6:
+      value = a | b;
+      break;
+    case 0x7:
+      value = a & b;
+      break;
+    }
+    break;
+  }
+  default:
+    return false;
+  }
+
+  result.pc = pc;
+  result.instruction = inst;
+  if (writes && rd != 0) {
+    regs[rd] = value;
+    result.rd = rd;
+    result.value = value;
+  } else {
+    result.rd = NO_REGISTER;
+    result.value = 0;
+  }
+  pc = next_pc;
+  return true;
+}
+
+#endif // CORE_INTERPRETER_HPP
@@ -1,23 +1,42 @@
 #ifndef CORE_MEMORY_HPP
 #define CORE_MEMORY_HPP
 
+#include "cache.hpp"
 #include "riscv/instruction.hpp"
 #include "utils/logger.hpp"
+#include "utils/queue.hpp"
+#include "utils/trace.hpp"
+#include <algorithm>
 #include <array>
 #include <cstdint>
-#include <map>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <ostream>
 #include <stdexcept>
-#include <unordered_map>
+#include <vector>
+
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::LSB
 
 struct LSBInstruction {
+  static constexpr uint32_t NO_TAG = std::numeric_limits<uint32_t>::max();
+
   std::variant<riscv::I_LoadOp, riscv::S_StoreOp> op_type;
-  int32_t address;
-  int32_t data;
-  int32_t imm; // Immediate offset for address calculation
+  int32_t address; // base register value
+  int32_t data;    // store data
+  int32_t imm;     // Immediate offset for address calculation
   uint32_t dest_tag;
   uint32_t rob_id;
-  bool can_execute;
+  uint32_t pc = 0;               // address of the instruction
+  uint32_t address_tag = NO_TAG; // ROB tag producing the base, if pending
+  uint32_t data_tag = NO_TAG;    // ROB tag producing the store data
+
+  bool address_ready() const { return address_tag == NO_TAG; }
+  bool data_ready() const { return data_tag == NO_TAG; }
 
   bool is_load() const {
     return std::holds_alternative<riscv::I_LoadOp>(op_type);
@@ -26,21 +45,72 @@ struct LSBInstruction {
   bool is_store() const {
     return std::holds_alternative<riscv::S_StoreOp>(op_type);
   }
+
+  uint32_t effective_address() const {
+    return static_cast<uint32_t>(address) + static_cast<uint32_t>(imm);
+  }
+
+  // Number of bytes read or written.
+  uint32_t access_size() const {
+    if (auto *load_op = std::get_if<riscv::I_LoadOp>(&op_type)) {
+      switch (*load_op) {
+      case riscv::I_LoadOp::LB:
+      case riscv::I_LoadOp::LBU:
+        return 1;
+      case riscv::I_LoadOp::LH:
+      case riscv::I_LoadOp::LHU:
+        return 2;
+      default:
+        return 4;
+      }
+    }
+    switch (std::get<riscv::S_StoreOp>(op_type)) {
+    case riscv::S_StoreOp::SB:
+      return 1;
+    case riscv::S_StoreOp::SH:
+      return 2;
+    default:
+      return 4;
+    }
+  }
 };
 
+/**
+ * @brief Sign- or zero-extends the low bytes of raw as the given load would.
+ */
+inline int32_t extend_load_value(uint32_t raw, riscv::I_LoadOp op) {
+  switch (op) {
+  case riscv::I_LoadOp::LB:
+    return static_cast<int8_t>(raw & 0xFF);
+  case riscv::I_LoadOp::LH:
+    return static_cast<int16_t>(raw & 0xFFFF);
+  case riscv::I_LoadOp::LBU:
+    return static_cast<int32_t>(raw & 0xFF);
+  case riscv::I_LoadOp::LHU:
+    return static_cast<int32_t>(raw & 0xFFFF);
+  default:
+    return static_cast<int32_t>(raw);
+  }
+}
+
 struct LSBEntry {
   LSBInstruction instruction;
   uint32_t cycles_remaining;
   bool committed;
   bool executing;
-  bool valid;
+  bool completed;   // load data broadcast, or store data written
+  bool speculative; // load issued past an older store with unknown address
+  bool replay;      // load read stale data and must re-execute at commit
+  std::optional<uint32_t> forwarded_from; // ROB ID of the supplying store
 
   LSBEntry()
-      : cycles_remaining(0), committed(false), executing(false), valid(false) {}
+      : cycles_remaining(0), committed(false), executing(false),
+        completed(false), speculative(false), replay(false) {}
 
   LSBEntry(LSBInstruction inst)
       : instruction(inst), cycles_remaining(0), committed(false),
-        executing(false), valid(true) {}
+        executing(false), completed(false), speculative(false),
+        replay(false) {}
 };
 
 struct MemoryResult {
@@ -57,8 +127,32 @@ struct MemoryResult {
   }
 };
 
+/**
+ * @brief Guest memory backed by a two-level page table of 4 KiB host pages.
+ *
+ * Pages are allocated on first write; reads from unmapped pages return zero
+ * without allocating. Accesses that do not cross a page boundary are served
+ * directly from the host page. map_block() can also point guest pages at
+ * caller-provided host memory (e.g. a private file mapping) without copying.
+ */
 class Memory {
-  std::unordered_map<uint32_t, uint8_t> memory_data;
+  static constexpr uint32_t PAGE_BITS = 12;
+  static constexpr uint32_t TABLE_BITS = 10;
+  static constexpr uint32_t DIRECTORY_BITS = 32 - PAGE_BITS - TABLE_BITS;
+  static constexpr uint32_t PAGE_SIZE = 1U << PAGE_BITS;
+  static constexpr uint32_t PAGE_MASK = PAGE_SIZE - 1;
+  static constexpr uint32_t TABLE_MASK = (1U << TABLE_BITS) - 1;
+
+  using Page = std::array<uint8_t, PAGE_SIZE>;
+  using PageTable = std::array<uint8_t *, 1U << TABLE_BITS>;
+
+  std::array<std::unique_ptr<PageTable>, 1U << DIRECTORY_BITS> page_directory;
+  std::vector<std::unique_ptr<Page>> owned_pages;
+  std::vector<std::shared_ptr<void>> external_backings;
+  std::function<void(uint32_t, uint32_t)> store_observer;
+
+  const uint8_t *find_page(uint32_t address) const;
+  uint8_t *get_page(uint32_t address);
 
 public:
   int32_t read(uint32_t address) const;
@@ -73,56 +167,209 @@ public:
 
   int32_t load(uint32_t address, riscv::I_LoadOp op) const;
   void store(uint32_t address, int32_t data, riscv::S_StoreOp op);
+  // Called after every guest store, e.g. to keep decoded code coherent.
+  void set_store_observer(
+      std::function<void(uint32_t address, uint32_t size)> observer);
 
-  void initialize_from_loader(const std::map<uint32_t, uint8_t> &loader_memory);
+  void read_block(uint32_t address, uint8_t *data, size_t size) const;
+  void write_block(uint32_t address, const uint8_t *data, size_t size);
+  void zero_block(uint32_t address, size_t size);
+  void map_block(uint32_t address, uint8_t *data, size_t size,
+                 std::shared_ptr<void> backing);
+  void copy_from(const Memory &other);
+  bool is_mapped(uint32_t address) const;
+  void clear();
 };
 
 constexpr size_t LSB_SIZE = 32;
 
+struct LSBConfig {
+  // Let loads issue before older store addresses are known. A store whose
+  // address turns out to overlap such a load makes the load replay.
+  bool speculative_loads = false;
+  // Accesses the pipelined memory unit can start per cycle. Each load port
+  // also drives one result bus, so up to load_ports results broadcast per
+  // cycle.
+  uint32_t load_ports = 1;
+  uint32_t store_ports = 1; // store buffer entries drained per cycle
+  // Cycles from start to completion when there is no L1 data cache.
+  uint32_t latency = 3;
+  // Post-commit store buffer: entries, and the aligned block each entry
+  // combines stores into (a power of two, at most 64 bytes).
+  uint32_t store_buffer_size = 8;
+  uint32_t store_buffer_block = 64;
+  // Cycles the youngest entry waits for further stores to combine before it
+  // drains, counted from the last store it took.
+  uint32_t store_combine_cycles = 4;
+};
+
+struct StoreBufferStats {
+  uint64_t stores = 0;      // committed stores accepted
+  uint64_t combined = 0;    // ... that merged into an existing entry
+  uint64_t drains = 0;      // entries written to the cache
+  uint64_t full_stalls = 0; // cycles commit waited for a free entry
+  uint64_t forwards = 0;    // loads served entirely from the buffer
+};
+
+/**
+ * @brief Post-commit store buffer.
+ *
+ * Committed stores write Memory as they enter, so the buffer only models
+ * timing: each entry collects the bytes written to one aligned block and
+ * drains them to the L1 data cache in the background, oldest first. A store
+ * to a block that already has an entry waiting to drain combines into it.
+ * Loads whose bytes are all buffered complete without a cache access, while
+ * loads that partially overlap an entry wait until it has drained.
+ */
+class StoreBuffer {
+  struct Entry {
+    uint32_t block_address = 0;
+    uint64_t byte_mask = 0; // bytes written within the block
+    uint32_t pc = 0;        // first store, for the cache's prefetcher
+    uint32_t cycles_remaining = 0;
+    uint32_t idle_cycles = 0; // since the last store combined into it
+    bool draining = false;
+  };
+
+public:
+  enum class Overlap { None, Partial, Full };
+
+  StoreBuffer(const LSBConfig &config, Cache *l1d);
+
+  bool can_accept(uint32_t address, uint32_t size);
+  void insert(uint32_t address, uint32_t size, uint32_t pc);
+  Overlap lookup(uint32_t address, uint32_t size) const;
+  void tick();
+
+  void count_forward() { stats.forwards++; }
+  void count_full_stall() { stats.full_stalls++; }
+  const StoreBufferStats &get_stats() const { return stats; }
+  void print_stats(std::ostream &os) const;
+  void set_tracer(TraceWriter *writer) { tracer = writer; }
+
+private:
+  uint32_t blocks_needed(uint32_t address, uint32_t size);
+  uint64_t block_mask(uint32_t block_address, uint32_t address,
+                      uint32_t size) const;
+  Entry *combinable_entry(uint32_t block_address);
+
+  CircularQueue<Entry> entries;
+  LSBConfig config;
+  Cache *l1d;
+  StoreBufferStats stats;
+  TraceWriter *tracer = nullptr;
+};
+
+/**
+ * @brief Load/store queue.
+ *
+ * Entries are allocated in program order at issue, pick up their base and
+ * store data from result broadcasts, and retire from the head once
+ * committed and completed. Position in the queue is the age order, so no
+ * ROB IDs are ever compared for age.
+ */
 class LSB {
-  std::array<LSBEntry, LSB_SIZE> lsb_entries;
-  std::optional<MemoryResult> broadcast_result;
-  std::optional<MemoryResult> next_broadcast_result;
-  Memory memory;
-  bool busy;
-  size_t entry_count;
+  CircularQueue<LSBEntry> queue;
+  // Committed entries, which always form the head of the queue; the next
+  // one is the oldest uncommitted entry.
+  int committed_entries = 0;
+  std::deque<MemoryResult> completed_results; // completion order
+  std::vector<MemoryResult> broadcast_results;
+  Memory &memory;
+  LSBConfig config;
+  Cache *l1d; // optional timing model in front of memory
+  StoreBuffer store_buffer;
+  TraceWriter *tracer = nullptr;
 
 public:
-  LSB();
+  explicit LSB(Memory &memory, const LSBConfig &config = {},
+               Cache *l1d = nullptr);
 
   bool is_full() const;
   void add_instruction(LSBInstruction instruction);
+  void receive_broadcast(int32_t value, uint32_t dest_tag);
 
   void tick();
-  bool has_result_for_broadcast() const;
-  MemoryResult get_result_for_broadcast() const;
+  const std::vector<MemoryResult> &get_results_for_broadcast() const;
 
+  bool can_commit(uint32_t rob_id);
   void commit_memory(uint32_t rob_id);
+  bool requires_replay(uint32_t rob_id);
+  void print_stats(std::ostream &os) const;
+  void set_tracer(TraceWriter *writer) {
+    tracer = writer;
+    store_buffer.set_tracer(writer);
+  }
 
-  bool is_available() const;
   void flush();
   Memory &get_memory();
 
 private:
-  LSBEntry *find_entry_by_rob_id(uint32_t rob_id);
-  LSBEntry *get_oldest_ready_entry();
-  void remove_entry(LSBEntry *entry);
+  enum class ForwardStatus { NoMatch, Forwarded, Blocked };
+  struct StoreLookup {
+    ForwardStatus status = ForwardStatus::NoMatch;
+    int32_t data = 0;
+    uint32_t store_rob_id = 0;
+    bool bypassed_unknown = false; // skipped an older unresolved store
+  };
+
+  StoreLookup lookup_older_stores(int index);
+  LSBEntry *oldest_uncommitted();
+  uint32_t access_latency(const LSBInstruction &instruction);
+  void start_accesses();
+  void forward_loads();
+  void advance_accesses();
+  void trace_start(const LSBEntry &entry);
+  void complete_load(LSBEntry &entry, int32_t data,
+                     std::optional<uint32_t> source);
+  void check_ordering_violations(int store_index);
+  void retire_completed();
 };
 
 // Memory implementation
+inline const uint8_t *Memory::find_page(uint32_t address) const {
+  const auto &table = page_directory[address >> (PAGE_BITS + TABLE_BITS)];
+  if (!table) {
+    return nullptr;
+  }
+  return (*table)[(address >> PAGE_BITS) & TABLE_MASK];
+}
+
+inline uint8_t *Memory::get_page(uint32_t address) {
+  auto &table = page_directory[address >> (PAGE_BITS + TABLE_BITS)];
+  if (!table) {
+    table = std::make_unique<PageTable>();
+  }
+  uint8_t *&page = (*table)[(address >> PAGE_BITS) & TABLE_MASK];
+  if (!page) {
+    // value-initialized, i.e. zero-filled
+    owned_pages.push_back(std::make_unique<Page>());
+    page = owned_pages.back()->data();
+  }
+  return page;
+}
+
 inline int32_t Memory::read(uint32_t address) const {
+  uint32_t offset = address & PAGE_MASK;
+  if (offset <= PAGE_SIZE - 4) {
+    const uint8_t *page = find_page(address);
+    if (!page) {
+      return 0;
+    }
+    const uint8_t *p = page + offset;
+    return static_cast<int32_t>(p[0] | (p[1] << 8) | (p[2] << 16) |
+                                (static_cast<uint32_t>(p[3]) << 24));
+  }
   uint8_t byte0 = read_byte_unsigned(address);
   uint8_t byte1 = read_byte_unsigned(address + 1);
   uint8_t byte2 = read_byte_unsigned(address + 2);
   uint8_t byte3 = read_byte_unsigned(address + 3);
   return static_cast<int32_t>(byte0 | (byte1 << 8) | (byte2 << 16) |
-                              (byte3 << 24));
+                              (static_cast<uint32_t>(byte3) << 24));
 }
 
 inline int16_t Memory::read_halfword(uint32_t address) const {
-  uint8_t byte0 = read_byte_unsigned(address);
-  uint8_t byte1 = read_byte_unsigned(address + 1);
-  return static_cast<int16_t>(byte0 | (byte1 << 8));
+  return static_cast<int16_t>(read_halfword_unsigned(address));
 }
 
 inline int8_t Memory::read_byte_signed(uint32_t address) const {
@@ -130,17 +377,35 @@ inline int8_t Memory::read_byte_signed(uint32_t address) const {
 }
 
 inline uint16_t Memory::read_halfword_unsigned(uint32_t address) const {
+  uint32_t offset = address & PAGE_MASK;
+  if (offset <= PAGE_SIZE - 2) {
+    const uint8_t *page = find_page(address);
+    if (!page) {
+      return 0;
+    }
+    const uint8_t *p = page + offset;
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+  }
   uint8_t byte0 = read_byte_unsigned(address);
   uint8_t byte1 = read_byte_unsigned(address + 1);
   return static_cast<uint16_t>(byte0 | (byte1 << 8));
 }
 
 inline uint8_t Memory::read_byte_unsigned(uint32_t address) const {
-  auto it = memory_data.find(address);
-  return (it != memory_data.end()) ? it->second : 0;
+  const uint8_t *page = find_page(address);
+  return page ? page[address & PAGE_MASK] : 0;
 }
 
 inline void Memory::write(uint32_t address, int32_t data) {
+  uint32_t offset = address & PAGE_MASK;
+  if (offset <= PAGE_SIZE - 4) {
+    uint8_t *p = get_page(address) + offset;
+    p[0] = static_cast<uint8_t>(data & 0xFF);
+    p[1] = static_cast<uint8_t>((data >> 8) & 0xFF);
+    p[2] = static_cast<uint8_t>((data >> 16) & 0xFF);
+    p[3] = static_cast<uint8_t>((data >> 24) & 0xFF);
+    return;
+  }
   write_byte(address, static_cast<uint8_t>(data & 0xFF));
   write_byte(address + 1, static_cast<uint8_t>((data >> 8) & 0xFF));
   write_byte(address + 2, static_cast<uint8_t>((data >> 16) & 0xFF));
@@ -148,12 +413,19 @@ inline void Memory::write(uint32_t address, int32_t data) {
 }
 
 inline void Memory::write_halfword(uint32_t address, int16_t data) {
+  uint32_t offset = address & PAGE_MASK;
+  if (offset <= PAGE_SIZE - 2) {
+    uint8_t *p = get_page(address) + offset;
+    p[0] = static_cast<uint8_t>(data & 0xFF);
+    p[1] = static_cast<uint8_t>((data >> 8) & 0xFF);
+    return;
+  }
   write_byte(address, static_cast<uint8_t>(data & 0xFF));
   write_byte(address + 1, static_cast<uint8_t>((data >> 8) & 0xFF));
 }
 
 inline void Memory::write_byte(uint32_t address, uint8_t data) {
-  memory_data[address] = data;
+  get_page(address)[address & PAGE_MASK] = data;
 }
 
 inline int32_t Memory::load(uint32_t address, riscv::I_LoadOp op) const {
@@ -174,190 +446,691 @@ inline int32_t Memory::load(uint32_t address, riscv::I_LoadOp op) const {
 }
 
 inline void Memory::store(uint32_t address, int32_t data, riscv::S_StoreOp op) {
+  uint32_t size;
   switch (op) {
   case riscv::S_StoreOp::SB:
     write_byte(address, static_cast<uint8_t>(data & 0xFF));
+    size = 1;
     break;
   case riscv::S_StoreOp::SH:
     write_halfword(address, static_cast<int16_t>(data & 0xFFFF));
+    size = 2;
     break;
   case riscv::S_StoreOp::SW:
     write(address, data);
+    size = 4;
     break;
   default:
     throw std::runtime_error("Invalid store operation");
   }
+  if (store_observer) {
+    store_observer(address, size);
+  }
 }
 
-inline void Memory::initialize_from_loader(
-    const std::map<uint32_t, uint8_t> &loader_memory) {
-  memory_data.clear();
-  for (const auto &entry : loader_memory) {
-    memory_data[entry.first] = entry.second;
+inline void Memory::set_store_observer(
+    std::function<void(uint32_t address, uint32_t size)> observer) {
+  store_observer = std::move(observer);
+}
+
+inline void Memory::read_block(uint32_t address, uint8_t *data,
+                               size_t size) const {
+  while (size > 0) {
+    uint32_t offset = address & PAGE_MASK;
+    size_t chunk = std::min<size_t>(size, PAGE_SIZE - offset);
+    const uint8_t *page = find_page(address);
+    if (page) {
+      std::memcpy(data, page + offset, chunk);
+    } else {
+      std::memset(data, 0, chunk);
+    }
+    address += static_cast<uint32_t>(chunk);
+    data += chunk;
+    size -= chunk;
   }
-  LOG_INFO("Memory initialized with " + std::to_string(loader_memory.size()) +
-           " bytes from binary loader");
 }
 
-// LSB implementation
-inline LSB::LSB()
-    : broadcast_result(std::nullopt), next_broadcast_result(std::nullopt),
-      busy(false), entry_count(0) {}
+inline void Memory::write_block(uint32_t address, const uint8_t *data,
+                                size_t size) {
+  while (size > 0) {
+    uint32_t offset = address & PAGE_MASK;
+    size_t chunk = std::min<size_t>(size, PAGE_SIZE - offset);
+    std::memcpy(get_page(address) + offset, data, chunk);
+    address += static_cast<uint32_t>(chunk);
+    data += chunk;
+    size -= chunk;
+  }
+}
 
-inline bool LSB::is_full() const { return entry_count >= LSB_SIZE; }
+/**
+ * @brief Zero-fills a guest range. Unmapped pages already read as zero and
+ * are left unallocated.
+ */
+inline void Memory::zero_block(uint32_t address, size_t size) {
+  while (size > 0) {
+    uint32_t offset = address & PAGE_MASK;
+    size_t chunk = std::min<size_t>(size, PAGE_SIZE - offset);
+    if (find_page(address)) {
+      std::memset(get_page(address) + offset, 0, chunk);
+    }
+    address += static_cast<uint32_t>(chunk);
+    size -= chunk;
+  }
+}
 
-inline LSBEntry *LSB::find_entry_by_rob_id(uint32_t rob_id) {
-  for (auto &entry : lsb_entries) {
-    if (entry.valid && entry.instruction.rob_id == rob_id) {
-      return &entry;
+/**
+ * @brief Backs a guest range with host memory instead of copying it.
+ *
+ * Guest pages that lie entirely inside the range are pointed directly at the
+ * corresponding host bytes, so guest stores write through to data. Partial
+ * pages at either end are copied. backing is kept alive for as long as the
+ * mapping exists.
+ * @param address Guest address of the first byte.
+ * @param data Host memory holding the range; must stay writable.
+ * @param size Length of the range in bytes.
+ * @param backing Owner of data, e.g. a private file mapping.
+ */
+inline void Memory::map_block(uint32_t address, uint8_t *data, size_t size,
+                              std::shared_ptr<void> backing) {
+  bool mapped_any = false;
+  while (size > 0) {
+    uint32_t offset = address & PAGE_MASK;
+    size_t chunk = std::min<size_t>(size, PAGE_SIZE - offset);
+    if (chunk == PAGE_SIZE) {
+      auto &table = page_directory[address >> (PAGE_BITS + TABLE_BITS)];
+      if (!table) {
+        table = std::make_unique<PageTable>();
+      }
+      (*table)[(address >> PAGE_BITS) & TABLE_MASK] = data;
+      mapped_any = true;
+    } else {
+      std::memcpy(get_page(address) + offset, data, chunk);
     }
+    address += static_cast<uint32_t>(chunk);
+    data += chunk;
+    size -= chunk;
+  }
+  if (mapped_any) {
+    external_backings.push_back(std::move(backing));
   }
-  return nullptr;
 }
 
-inline LSBEntry *LSB::get_oldest_ready_entry() {
-  LSBEntry *oldest = nullptr;
-  for (auto &entry : lsb_entries) {
-    if (entry.valid &&
-        (!oldest || entry.instruction.rob_id < oldest->instruction.rob_id)) {
-      oldest = &entry;
+/**
+ * @brief Copies every page other has touched into this memory, which then
+ * owns private copies of them. Store observers are not copied.
+ */
+inline void Memory::copy_from(const Memory &other) {
+  for (uint32_t dir = 0; dir < other.page_directory.size(); dir++) {
+    if (!other.page_directory[dir]) {
+      continue;
+    }
+    const PageTable &table = *other.page_directory[dir];
+    for (uint32_t index = 0; index < table.size(); index++) {
+      if (table[index]) {
+        uint32_t address =
+            (dir << (PAGE_BITS + TABLE_BITS)) | (index << PAGE_BITS);
+        std::memcpy(get_page(address), table[index], PAGE_SIZE);
+      }
     }
   }
-  return oldest;
 }
 
-inline void LSB::remove_entry(LSBEntry *entry) {
-  if (entry && entry->valid) {
-    entry->valid = false;
-    entry_count--;
+inline bool Memory::is_mapped(uint32_t address) const {
+  return find_page(address) != nullptr;
+}
+
+inline void Memory::clear() {
+  for (auto &table : page_directory) {
+    table.reset();
   }
+  owned_pages.clear();
+  external_backings.clear();
 }
 
-inline void LSB::add_instruction(LSBInstruction instruction) {
-  LSBEntry *existing_entry = find_entry_by_rob_id(instruction.rob_id);
-
-  if (existing_entry) {
-    existing_entry->instruction.can_execute = instruction.can_execute;
-    existing_entry->instruction.address = instruction.address;
-    existing_entry->instruction.data = instruction.data;
-    existing_entry->instruction.imm = instruction.imm;
-    existing_entry->instruction.dest_tag = instruction.dest_tag;
-    LOG_DEBUG("Updated can_execute for existing LSB entry with ROB ID: " +
-              std::to_string(instruction.rob_id) + " to " +
-              std::to_string(instruction.can_execute));
-    return;
+// StoreBuffer implementation
+inline StoreBuffer::StoreBuffer(const LSBConfig &config, Cache *l1d)
+    : entries(static_cast<int>(config.store_buffer_size)), config(config),
+      l1d(l1d) {}
+
+inline uint64_t StoreBuffer::block_mask(uint32_t block_address,
+                                        uint32_t address,
+                                        uint32_t size) const {
+  uint64_t mask = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    uint32_t offset = address + i - block_address;
+    if (offset < config.store_buffer_block) {
+      mask |= uint64_t{1} << offset;
+    }
   }
+  return mask;
+}
 
-  if (is_full()) {
-    throw std::runtime_error("LSB is full");
+/**
+ * @brief Finds the entry a store to block_address can combine into: the
+ * youngest entry for that block, if it has not started draining.
+ */
+inline StoreBuffer::Entry *
+StoreBuffer::combinable_entry(uint32_t block_address) {
+  for (int i = entries.size() - 1; i >= 0; i--) {
+    Entry &entry = entries.get(i);
+    if (entry.block_address == block_address) {
+      return entry.draining ? nullptr : &entry;
+    }
   }
+  return nullptr;
+}
 
-  // Find first available slot
-  for (auto &entry : lsb_entries) {
-    if (!entry.valid) {
-      entry = LSBEntry(instruction);
-      entry_count++;
-      busy = true;
+/**
+ * @brief Number of new entries a store needs; it may span several blocks.
+ */
+inline uint32_t StoreBuffer::blocks_needed(uint32_t address, uint32_t size) {
+  uint32_t first = address & ~(config.store_buffer_block - 1);
+  uint32_t last = (address + size - 1) & ~(config.store_buffer_block - 1);
+  uint32_t needed = 0;
+  for (uint32_t block = first;; block += config.store_buffer_block) {
+    if (!combinable_entry(block)) {
+      needed++;
+    }
+    if (block == last) {
       break;
     }
   }
+  return needed;
 }
 
-inline bool LSB::is_available() const { return !busy; }
-
-inline bool LSB::has_result_for_broadcast() const {
-  return broadcast_result.has_value();
+inline bool StoreBuffer::can_accept(uint32_t address, uint32_t size) {
+  return blocks_needed(address, size) <=
+         config.store_buffer_size - static_cast<uint32_t>(entries.size());
 }
 
-inline MemoryResult LSB::get_result_for_broadcast() const {
-  if (!broadcast_result.has_value()) {
-    throw std::runtime_error("No memory result available for broadcast");
+/**
+ * @brief Records a committed store. The caller has checked can_accept().
+ */
+inline void StoreBuffer::insert(uint32_t address, uint32_t size,
+                                uint32_t pc) {
+  stats.stores++;
+  uint32_t first = address & ~(config.store_buffer_block - 1);
+  uint32_t last = (address + size - 1) & ~(config.store_buffer_block - 1);
+  bool combined = false;
+  for (uint32_t block = first;; block += config.store_buffer_block) {
+    uint64_t mask = block_mask(block, address, size);
+    if (Entry *existing = combinable_entry(block)) {
+      existing->byte_mask |= mask;
+      existing->idle_cycles = 0;
+      combined = true;
+    } else {
+      Entry entry;
+      entry.block_address = block;
+      entry.byte_mask = mask;
+      entry.pc = pc;
+      entries.enqueue(entry);
+    }
+    if (block == last) {
+      break;
+    }
+  }
+  if (combined) {
+    stats.combined++;
   }
-  return broadcast_result.value();
 }
 
-inline void LSB::commit_memory(uint32_t rob_id) {
-  for (auto &entry : lsb_entries) {
-    if (entry.valid && entry.instruction.rob_id <= rob_id) {
-      entry.committed = true;
-      LOG_DEBUG("Committed STORE instruction for ROB ID: " +
-                std::to_string(rob_id));
+/**
+ * @brief How the bytes of a load overlap buffered stores.
+ */
+inline StoreBuffer::Overlap StoreBuffer::lookup(uint32_t address,
+                                                uint32_t size) const {
+  uint32_t first = address & ~(config.store_buffer_block - 1);
+  uint32_t last = (address + size - 1) & ~(config.store_buffer_block - 1);
+  bool any = false, all = true;
+  for (uint32_t block = first;; block += config.store_buffer_block) {
+    uint64_t wanted = block_mask(block, address, size);
+    uint64_t buffered = 0;
+    for (int i = 0; i < entries.size(); i++) {
+      const Entry &entry = entries.get(i);
+      if (entry.block_address == block) {
+        buffered |= entry.byte_mask;
+      }
+    }
+    any |= (buffered & wanted) != 0;
+    all &= (buffered & wanted) == wanted;
+    if (block == last) {
+      break;
     }
   }
+  if (!any) {
+    return Overlap::None;
+  }
+  return all ? Overlap::Full : Overlap::Partial;
 }
 
-inline void LSB::tick() {
-  broadcast_result = next_broadcast_result;
-  next_broadcast_result = std::nullopt;
+/**
+ * @brief Starts up to store_ports drains, oldest first, advances the ones in
+ * flight and frees drained entries from the head. The youngest entry is held
+ * back for store_combine_cycles in case more stores to its block follow.
+ */
+inline void StoreBuffer::tick() {
+  uint32_t started = 0;
+  for (int i = 0; i < entries.size(); i++) {
+    Entry &entry = entries.get(i);
+    if (entry.draining) {
+      if (entry.cycles_remaining > 0) {
+        entry.cycles_remaining--;
+      }
+      continue;
+    }
+    if (started == config.store_ports) {
+      continue;
+    }
+    if (i == entries.size() - 1 &&
+        entry.idle_cycles < config.store_combine_cycles) {
+      entry.idle_cycles++;
+      continue;
+    }
+    entry.draining = true;
+    if (l1d) {
+      // One write covering the span of bytes the entry collected.
+      uint32_t low = __builtin_ctzll(entry.byte_mask);
+      uint32_t high = 63 - __builtin_clzll(entry.byte_mask);
+      entry.cycles_remaining = l1d->access(entry.block_address + low,
+                                           high - low + 1, true, entry.pc);
+    } else {
+      entry.cycles_remaining = config.latency;
+    }
+    entry.cycles_remaining--;
+    started++;
+    stats.drains++;
+    if (tracer) {
+      tracer->record(TraceEvent::MemStart, TRACE_NO_ROB, entry.pc,
+                     entry.block_address, TraceUnit::StoreBuffer);
+    }
+  }
 
-  if (entry_count == 0) {
-    busy = false;
-    return;
+  while (!entries.isEmpty() && entries.front().draining &&
+         entries.front().cycles_remaining == 0) {
+    if (tracer) {
+      tracer->record(TraceEvent::MemFinish, TRACE_NO_ROB, entries.front().pc,
+                     entries.front().block_address, TraceUnit::StoreBuffer);
+    }
+    entries.dequeue();
   }
+}
 
-  LOG_DEBUG("Memory Unit Executing: " + std::to_string(entry_count) +
-            " entries in LSB");
+inline void StoreBuffer::print_stats(std::ostream &os) const {
+  os << "Store buffer: " << config.store_buffer_size << " entries, "
+     << config.store_buffer_block << " B blocks\n"
+     << "  stores " << stats.stores << "  combined " << stats.combined
+     << "  drains " << stats.drains << "  full stalls " << stats.full_stalls
+     << "  load forwards " << stats.forwards << "\n";
+}
 
-  LSBEntry *entry = get_oldest_ready_entry();
-  if (!entry) {
-    busy = entry_count > 0;
-    return;
+// LSB implementation
+inline LSB::LSB(Memory &memory, const LSBConfig &config, Cache *l1d)
+    : queue(LSB_SIZE), memory(memory), config(config), l1d(l1d),
+      store_buffer(config, l1d) {}
+
+inline bool LSB::is_full() const { return queue.isFull(); }
+
+/**
+ * @brief Checks the load at index against the older stores in the queue.
+ *
+ * Uncommitted stores are visited from youngest to oldest; committed ones are
+ * already visible in memory. The first one known to
+ * overlap the load decides the outcome: if its data is ready and covers
+ * every byte of the load the data can be forwarded, otherwise the load has
+ * to wait for that store to reach memory. A store passed on the way whose
+ * address is still unknown might alias the load, so it blocks the load as
+ * well unless speculative loads are enabled.
+ */
+inline LSB::StoreLookup LSB::lookup_older_stores(int index) {
+  StoreLookup lookup;
+  const LSBInstruction &load = queue.get(index).instruction;
+  uint32_t load_address = load.effective_address();
+  uint32_t load_size = load.access_size();
+
+  for (int i = index - 1; i >= 0; i--) {
+    const LSBEntry &entry = queue.get(i);
+    // A committed store has already written memory, and so has every store
+    // older than it.
+    if (!entry.instruction.is_store() || entry.completed) {
+      continue;
+    }
+    if (!entry.instruction.address_ready()) {
+      if (!config.speculative_loads) {
+        lookup.status = ForwardStatus::Blocked;
+        return lookup;
+      }
+      lookup.bypassed_unknown = true;
+      continue;
+    }
+    uint32_t store_address = entry.instruction.effective_address();
+    uint32_t store_size = entry.instruction.access_size();
+    if (load_address - store_address >= store_size &&
+        store_address - load_address >= load_size) {
+      continue;
+    }
+
+    uint32_t offset = load_address - store_address;
+    if (!entry.instruction.data_ready() || load_address < store_address ||
+        offset + load_size > store_size) {
+      lookup.status = ForwardStatus::Blocked;
+      return lookup;
+    }
+    uint32_t raw =
+        static_cast<uint32_t>(entry.instruction.data) >> (offset * 8);
+    lookup.status = ForwardStatus::Forwarded;
+    lookup.data =
+        extend_load_value(raw, std::get<riscv::I_LoadOp>(load.op_type));
+    lookup.store_rob_id = entry.instruction.rob_id;
+    return lookup;
   }
+  return lookup;
+}
 
-  uint32_t effective_address =
-      entry->instruction.address + entry->instruction.imm;
+/**
+ * @brief Looks an access up in the L1 data cache.
+ * @return Cycles until the access completes.
+ */
+inline uint32_t LSB::access_latency(const LSBInstruction &instruction) {
+  if (!l1d) {
+    return config.latency;
+  }
+  return l1d->access(instruction.effective_address(),
+                     instruction.access_size(), instruction.is_store(),
+                     instruction.pc);
+}
 
-  LOG_DEBUG("Processing Instruction: rob_id=" +
-            std::to_string(entry->instruction.rob_id) +
-            ", effective_addr=" + std::to_string(effective_address) +
-            ", op_type=" + (entry->instruction.is_load() ? "LOAD" : "STORE") +
-            ", committed=" + std::to_string(entry->committed) +
-            ", executing=" + std::to_string(entry->executing) +
-            ", can_execute=" + std::to_string(entry->instruction.can_execute));
+/**
+ * @brief Starts up to load_ports loads, oldest first.
+ *
+ * Loads may start out of order as soon as their address is known and no
+ * older store overlaps them (or, without speculation, might overlap them).
+ * Stores never start here: they write memory when they commit and drain
+ * through the store buffer. A load that overlaps the store buffer is left to
+ * forward_loads() if every byte is buffered, and otherwise waits for the
+ * overlapping entries to drain.
+ */
+inline void LSB::start_accesses() {
+  uint32_t loads_started = 0;
 
-  if (!entry->instruction.can_execute && !entry->executing) {
-    LOG_DEBUG("Instruction with ROB ID " +
-              std::to_string(entry->instruction.rob_id) +
-              " cannot execute, blocking all subsequent instructions");
-    busy = entry_count > 0;
-    return;
+  for (int i = 0; i < queue.size() && loads_started < config.load_ports;
+       i++) {
+    LSBEntry &entry = queue.get(i);
+    if (!entry.instruction.is_load() || entry.completed || entry.executing ||
+        !entry.instruction.address_ready()) {
+      continue;
+    }
+    StoreLookup lookup = lookup_older_stores(i);
+    if (lookup.status != ForwardStatus::NoMatch ||
+        store_buffer.lookup(entry.instruction.effective_address(),
+                            entry.instruction.access_size()) !=
+            StoreBuffer::Overlap::None) {
+      continue;
+    }
+    entry.executing = true;
+    entry.cycles_remaining = access_latency(entry.instruction);
+    entry.speculative = lookup.bypassed_unknown;
+    loads_started++;
+    trace_start(entry);
+    LOG_DEBUG("Memory unit started load with ROB ID {}{}",
+              entry.instruction.rob_id,
+              entry.speculative ? " (speculative)" : "");
   }
+}
 
-  if (!entry->executing) {
-    bool can_execute = (entry->instruction.is_load() ||
-                        (entry->instruction.is_store() && entry->committed)) &&
-                       entry->instruction.can_execute;
+/**
+ * @brief Completes every waiting load that can take its data from an older
+ * store in the queue or from the store buffer, bypassing the cache.
+ */
+inline void LSB::forward_loads() {
+  for (int i = 0; i < queue.size(); i++) {
+    LSBEntry &entry = queue.get(i);
+    if (!entry.instruction.is_load() || !entry.instruction.address_ready() ||
+        entry.executing || entry.completed) {
+      continue;
+    }
+    StoreLookup lookup = lookup_older_stores(i);
+    if (lookup.status == ForwardStatus::Forwarded) {
+      LOG_DEBUG("Forwarded store data to load with ROB ID {}: {}",
+                entry.instruction.rob_id, lookup.data);
+      entry.speculative = lookup.bypassed_unknown;
+      trace_start(entry);
+      complete_load(entry, lookup.data, lookup.store_rob_id);
+    } else if (lookup.status == ForwardStatus::NoMatch &&
+               store_buffer.lookup(entry.instruction.effective_address(),
+                                   entry.instruction.access_size()) ==
+                   StoreBuffer::Overlap::Full) {
+      // Committed stores are already in memory; only the timing differs.
+      LOG_DEBUG("Store buffer forwarded to load with ROB ID {}",
+                entry.instruction.rob_id);
+      store_buffer.count_forward();
+      entry.speculative = lookup.bypassed_unknown;
+      trace_start(entry);
+      auto load_op = std::get<riscv::I_LoadOp>(entry.instruction.op_type);
+      complete_load(entry,
+                    memory.load(entry.instruction.effective_address(), load_op),
+                    std::nullopt);
+    }
+  }
+}
 
-    if (can_execute) {
-      entry->executing = true;
-      entry->cycles_remaining = 3;
+/**
+ * @brief Advances every in-flight load by one cycle. Loads that finish read
+ * memory and queue their result.
+ */
+inline void LSB::advance_accesses() {
+  for (int i = 0; i < queue.size(); i++) {
+    LSBEntry &entry = queue.get(i);
+    if (!entry.executing || --entry.cycles_remaining > 0) {
+      continue;
     }
+
+    auto load_op = std::get<riscv::I_LoadOp>(entry.instruction.op_type);
+    complete_load(entry,
+                  memory.load(entry.instruction.effective_address(), load_op),
+                  std::nullopt);
   }
+}
 
-  if (entry->executing) {
-    entry->cycles_remaining--;
+inline void LSB::trace_start(const LSBEntry &entry) {
+  if (tracer) {
+    tracer->record(TraceEvent::MemStart, entry.instruction.rob_id,
+                   entry.instruction.pc, entry.instruction.effective_address(),
+                   TraceUnit::Memory);
+  }
+}
+
+/**
+ * @brief Queues a load's data for broadcast. The entry stays in the LSB
+ * until commit so that a store resolving later can still detect that it read
+ * stale data.
+ * @param source ROB ID of the store the data was forwarded from, if any.
+ */
+inline void LSB::complete_load(LSBEntry &entry, int32_t data,
+                               std::optional<uint32_t> source) {
+  MemoryResult result;
+  result.data = data;
+  result.dest_tag = entry.instruction.dest_tag;
+  result.rob_id = entry.instruction.rob_id;
+  result.op_type = entry.instruction.op_type;
+  completed_results.push_back(result);
+
+  entry.executing = false;
+  entry.completed = true;
+  entry.forwarded_from = source;
+  if (tracer) {
+    tracer->record(TraceEvent::MemFinish, entry.instruction.rob_id,
+                   entry.instruction.pc, static_cast<uint32_t>(data),
+                   TraceUnit::Memory);
+  }
+}
 
-    if (entry->cycles_remaining == 0) {
-      MemoryResult result;
-      result.rob_id = entry->instruction.rob_id;
-      result.op_type = entry->instruction.op_type;
+/**
+ * @brief Flags younger speculative loads that the store at store_index
+ * overlaps now that its address is known. Such a load read its data from
+ * memory or from a store older than this one, so the value is stale.
+ */
+inline void LSB::check_ordering_violations(int store_index) {
+  const LSBInstruction &store = queue.get(store_index).instruction;
+  uint32_t store_address = store.effective_address();
+  uint32_t store_size = store.access_size();
 
-      if (entry->instruction.is_load()) {
-        auto load_op = std::get<riscv::I_LoadOp>(entry->instruction.op_type);
-        result.data = memory.load(effective_address, load_op);
-        result.dest_tag = entry->instruction.dest_tag;
-      } else {
-        auto store_op = std::get<riscv::S_StoreOp>(entry->instruction.op_type);
-        memory.store(effective_address, entry->instruction.data, store_op);
-        result.data = 0;
-        result.dest_tag = 0;
+  for (int i = store_index + 1; i < queue.size(); i++) {
+    LSBEntry &entry = queue.get(i);
+    if (!entry.instruction.is_load() || !entry.speculative ||
+        (!entry.executing && !entry.completed)) {
+      continue;
+    }
+    uint32_t load_address = entry.instruction.effective_address();
+    uint32_t load_size = entry.instruction.access_size();
+    if (load_address - store_address >= store_size &&
+        store_address - load_address >= load_size) {
+      continue;
+    }
+
+    bool forwarded_from_younger = false;
+    if (entry.forwarded_from) {
+      for (int j = store_index + 1; j < i; j++) {
+        if (queue.get(j).instruction.rob_id == *entry.forwarded_from) {
+          forwarded_from_younger = true;
+          break;
+        }
       }
+    }
+    if (!forwarded_from_younger) {
+      entry.replay = true;
+      LOG_DEBUG(
+          "Memory ordering violation: load ROB ID {} overlaps store ROB ID {}",
+          entry.instruction.rob_id, store.rob_id);
+    }
+  }
+}
+
+/**
+ * @brief Frees committed entries at the head whose access has completed.
+ */
+inline void LSB::retire_completed() {
+  while (!queue.isEmpty() && queue.front().committed &&
+         queue.front().completed) {
+    queue.dequeue();
+    committed_entries--;
+  }
+}
 
-      next_broadcast_result = result;
-      remove_entry(entry);
+inline void LSB::add_instruction(LSBInstruction instruction) {
+  if (is_full()) {
+    throw std::runtime_error("LSB is full");
+  }
+  queue.enqueue(LSBEntry(instruction));
+  LOG_DEBUG("Allocated LSB entry for ROB ID: {}", instruction.rob_id);
+}
+
+/**
+ * @brief Captures a broadcast result into every entry waiting on dest_tag.
+ */
+inline void LSB::receive_broadcast(int32_t value, uint32_t dest_tag) {
+  for (int i = 0; i < queue.size(); i++) {
+    LSBInstruction &instruction = queue.get(i).instruction;
+    if (instruction.data_tag == dest_tag) {
+      instruction.data = value;
+      instruction.data_tag = LSBInstruction::NO_TAG;
+    }
+    if (instruction.address_tag == dest_tag) {
+      instruction.address = value;
+      instruction.address_tag = LSBInstruction::NO_TAG;
+      LOG_DEBUG("Resolved address for LSB entry with ROB ID: {}",
+                instruction.rob_id);
+      if (instruction.is_store() && config.speculative_loads) {
+        check_ordering_violations(i);
+      }
     }
   }
-  busy = entry_count > 0;
+}
+
+inline const std::vector<MemoryResult> &
+LSB::get_results_for_broadcast() const {
+  return broadcast_results;
+}
+
+/**
+ * @brief The oldest entry not yet committed, or nullptr. Instructions commit
+ * in order, so a committing memory instruction can only be this one.
+ */
+inline LSBEntry *LSB::oldest_uncommitted() {
+  return committed_entries < queue.size() ? &queue.get(committed_entries)
+                                          : nullptr;
+}
+
+/**
+ * @brief Whether the instruction with this ROB ID can commit this cycle; a
+ * store needs room in the store buffer.
+ */
+inline bool LSB::can_commit(uint32_t rob_id) {
+  LSBEntry *entry = oldest_uncommitted();
+  if (!entry || entry->instruction.rob_id != rob_id ||
+      !entry->instruction.is_store() ||
+      store_buffer.can_accept(entry->instruction.effective_address(),
+                              entry->instruction.access_size())) {
+    return true;
+  }
+  store_buffer.count_full_stall();
+  return false;
+}
+
+/**
+ * @brief Marks the entry of a committing instruction. A store writes memory
+ * and moves into the store buffer; its queue entry is done.
+ */
+inline void LSB::commit_memory(uint32_t rob_id) {
+  LSBEntry *entry = oldest_uncommitted();
+  if (!entry || entry->instruction.rob_id != rob_id) {
+    return;
+  }
+  entry->committed = true;
+  committed_entries++;
+  LOG_DEBUG("Committed memory instruction for ROB ID: {}", rob_id);
+
+  const LSBInstruction &instruction = entry->instruction;
+  if (instruction.is_store()) {
+    memory.store(instruction.effective_address(), instruction.data,
+                 std::get<riscv::S_StoreOp>(instruction.op_type));
+    store_buffer.insert(instruction.effective_address(),
+                        instruction.access_size(), instruction.pc);
+    entry->completed = true;
+  }
+}
+
+/**
+ * @brief Whether the load with this ROB ID must be squashed and re-executed
+ * instead of committing.
+ */
+inline bool LSB::requires_replay(uint32_t rob_id) {
+  const LSBEntry *entry = oldest_uncommitted();
+  return entry && entry->instruction.rob_id == rob_id && entry->replay;
+}
+
+inline void LSB::print_stats(std::ostream &os) const {
+  store_buffer.print_stats(os);
+}
+
+inline void LSB::tick() {
+  broadcast_results.clear();
+  store_buffer.tick();
+  if (!queue.isEmpty()) {
+    LOG_DEBUG("Memory Unit Executing: {} entries in LSB", queue.size());
+
+    start_accesses();
+    forward_loads();
+    advance_accesses();
+    retire_completed();
+  }
+
+  // Results go out in completion order as soon as they complete, so a load
+  // that starts this cycle broadcasts latency cycles later, like the ALUs.
+  while (!completed_results.empty() &&
+         broadcast_results.size() < config.load_ports) {
+    broadcast_results.push_back(completed_results.front());
+    completed_results.pop_front();
+  }
 }
 
 inline Memory &LSB::get_memory() { return memory; }
@@ -365,16 +1138,13 @@ inline Memory &LSB::get_memory() { return memory; }
 inline void LSB::flush() {
   LOG_DEBUG("Flushing LSB - removing non-committed entries");
 
-  for (auto &entry : lsb_entries) {
-    if (entry.valid && !entry.committed) {
-      remove_entry(&entry);
-    }
+  // Uncommitted entries always form the tail of the queue.
+  while (!queue.isEmpty() && !queue.rear().committed) {
+    queue.remove(queue.size() - 1);
   }
 
-  if (entry_count == 0) {
-    broadcast_result = std::nullopt;
-    next_broadcast_result = std::nullopt;
-    busy = false;
-  }
+  // Any pending load result belongs to a squashed load.
+  completed_results.clear();
+  broadcast_results.clear();
 }
-#endif // CORE_MEMORY_HPP
\ No newline at end of file
+#endif // CORE_MEMORY_HPP
@@ -4,11 +4,15 @@
 #include "../riscv/instruction.hpp"
 #include "../utils/logger.hpp"
 #include <cstdint>
+#include <deque>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <variant>
 
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::PRED
+
 struct PredictorInstruction {
   uint32_t rob_id;
   uint32_t pc;
@@ -23,16 +27,28 @@ struct PredictorResult {
   uint32_t rob_id;
   bool prediction;
   uint32_t pc;
+  uint32_t return_address; // pc + 4, what JAL and JALR write to rd
   std::optional<uint32_t> dest_tag;
   uint32_t target_pc;      // predicted target address
   bool is_mispredicted;    // Whether this was a misprediction
   uint32_t correct_target; // Correct target if mispredicted
 };
 
+/**
+ * @brief A pipelined branch unit: it accepts one instruction per cycle and
+ * broadcasts each result latency cycles later.
+ */
 class Predictor {
+  struct InFlight {
+    PredictorInstruction instruction;
+    uint32_t cycles_remaining;
+  };
+
+  std::deque<InFlight> in_flight; // oldest first
+  uint32_t latency;
+  // The instruction being resolved by tick().
   std::optional<PredictorInstruction> current_instruction;
   std::optional<PredictorResult> broadcast_result;
-  std::optional<PredictorResult> next_broadcast_result;
 
   // Helper function for hex formatting
   std::string to_hex(uint32_t value) const {
@@ -44,7 +60,7 @@ class Predictor {
   bool busy = false;
 
 public:
-  Predictor();
+  explicit Predictor(uint32_t latency = 2);
   bool is_available() const;
   void set_instruction(PredictorInstruction instruction);
   bool has_result_for_broadcast() const;
@@ -60,9 +76,9 @@ private:
                                                 riscv::B_BranchOp> &type) const;
 };
 
-inline Predictor::Predictor()
-    : current_instruction(std::nullopt), broadcast_result(std::nullopt),
-      next_broadcast_result(std::nullopt) {}
+inline Predictor::Predictor(uint32_t latency)
+    : latency(latency), current_instruction(std::nullopt),
+      broadcast_result(std::nullopt) {}
 
 inline bool Predictor::is_available() const { return !busy; }
 
@@ -75,13 +91,13 @@ inline PredictorResult Predictor::get_result_for_broadcast() const {
     throw std::runtime_error("No prediction result available for broadcast");
   }
   PredictorResult result = broadcast_result.value();
-  LOG_DEBUG("Returning predictor result: target=" + to_hex(result.target_pc) +
-            ", prediction=" + std::to_string(result.prediction));
+  LOG_DEBUG("Returning predictor result: target={}, prediction={}",
+            to_hex(result.target_pc), result.prediction);
   return result;
 }
 
 inline void Predictor::set_instruction(PredictorInstruction instruction) {
-  current_instruction = instruction;
+  in_flight.push_back({instruction, latency});
   busy = true;
 }
 
@@ -118,10 +134,8 @@ inline bool Predictor::is_prediction_correct() const {
     default:
       throw std::runtime_error("Invalid branch operation type");
     }
-    LOG_DEBUG(
-        "Branch evaluation: rs1=" + std::to_string(current_instruction->rs1) +
-        ", rs2=" + std::to_string(current_instruction->rs2) +
-        ", should_take=" + std::to_string(should_take));
+    LOG_DEBUG("Branch evaluation: rs1={}, rs2={}, should_take={}",
+              current_instruction->rs1, current_instruction->rs2, should_take);
     return should_take;
   }
   return false;
@@ -139,33 +153,37 @@ inline uint32_t Predictor::calculate_target_pc() const {
           current_instruction->branch_type) ||
       std::holds_alternative<riscv::J_Op>(current_instruction->branch_type)) {
     uint32_t target = current_instruction->pc + current_instruction->imm;
-    LOG_DEBUG(
-        "Branch/JAL target calculation: " + to_hex(current_instruction->pc) +
-        " + " + std::to_string(current_instruction->imm) + " = " +
-        to_hex(target));
+    LOG_DEBUG("Branch/JAL target calculation: {} + {} = {}",
+              to_hex(current_instruction->pc), current_instruction->imm,
+              to_hex(target));
     return target;
   } else if (std::holds_alternative<riscv::I_JumpOp>(
                  current_instruction->branch_type)) {
     uint32_t target =
         (current_instruction->rs1 + current_instruction->imm) & ~1U;
-    target += 4;
-    LOG_DEBUG("JALR target calculation: (" +
-              std::to_string(current_instruction->rs1) + " + " +
-              std::to_string(current_instruction->imm) +
-              ") & ~1 = " + to_hex(target));
+    LOG_DEBUG("JALR target calculation: ({} + {}) & ~1 = {}",
+              current_instruction->rs1, current_instruction->imm,
+              to_hex(target));
     return target;
   }
   return current_instruction->pc + 4;
 }
 
 inline void Predictor::tick() {
-  broadcast_result = next_broadcast_result;
-  next_broadcast_result = std::nullopt;
+  broadcast_result = std::nullopt;
+  for (InFlight &entry : in_flight) {
+    entry.cycles_remaining--;
+  }
+  if (!in_flight.empty() && in_flight.front().cycles_remaining == 0) {
+    current_instruction = in_flight.front().instruction;
+    in_flight.pop_front();
+  }
 
   if (current_instruction.has_value()) {
     PredictorResult new_result;
     new_result.dest_tag = current_instruction->dest_tag;
     new_result.pc = current_instruction->pc;
+    new_result.return_address = current_instruction->pc + 4;
     new_result.target_pc = calculate_target_pc();
     new_result.is_mispredicted = false;
     new_result.correct_target = new_result.target_pc;
@@ -186,30 +204,26 @@ inline void Predictor::tick() {
         new_result.is_mispredicted = true;
         new_result.correct_target =
             actual_taken ? new_result.target_pc : (new_result.pc + 4);
-        LOG_WARN("Branch misprediction detected! Predicted: " +
-                 std::to_string(new_result.prediction) +
-                 ", Actual: " + std::to_string(actual_taken));
+        LOG_WARN("Branch misprediction detected! Predicted: {}, Actual: {}",
+                 new_result.prediction, actual_taken);
       }
     }
 
-    LOG_INFO("Predictor calculating: PC=" + to_hex(current_instruction->pc) +
-             ", imm=" + std::to_string(current_instruction->imm) +
-             ", target=" + to_hex(new_result.target_pc) +
-             ", mispredicted=" + std::to_string(new_result.is_mispredicted));
+    LOG_INFO("Predictor calculating: PC={}, imm={}, target={}, mispredicted={}",
+             to_hex(current_instruction->pc), current_instruction->imm,
+             to_hex(new_result.target_pc), new_result.is_mispredicted);
 
-    next_broadcast_result = new_result;
+    broadcast_result = new_result;
     current_instruction = std::nullopt;
-  } else {
-    next_broadcast_result = std::nullopt;
   }
   busy = false;
 }
 
 inline void Predictor::flush() {
   LOG_DEBUG("Flushing Predictor - clearing current instruction and results");
+  in_flight.clear();
   current_instruction = std::nullopt;
   broadcast_result = std::nullopt;
-  next_broadcast_result = std::nullopt;
   busy = false;
 }
 
@@ -0,0 +1,187 @@
+#ifndef CORE_PREFETCHER_HPP
+#define CORE_PREFETCHER_HPP
+
+#include "../utils/config.hpp"
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+enum class PrefetcherType { NextLine, Stride };
+
+struct PrefetcherConfig {
+  PrefetcherType type = PrefetcherType::Stride;
+  uint32_t degree = 2;      // lines requested per trigger
+  uint32_t distance = 1;    // how far ahead the first request is, in strides
+  uint32_t table_size = 64; // stride: PC-indexed entries, a power of two
+
+  /**
+   * @brief Checks the degree and table size.
+   * @throws std::invalid_argument on an unusable configuration.
+   */
+  void validate() const {
+    if (degree == 0 || distance == 0) {
+      throw std::invalid_argument(
+          "prefetch degree and distance must be positive");
+    }
+    if (table_size == 0 || (table_size & (table_size - 1)) != 0) {
+      throw std::invalid_argument(
+          "prefetch table size must be a power of two");
+    }
+  }
+};
+
+/**
+ * @brief Parses a comma-separated key=value prefetcher description on top of
+ * base, e.g. "type=stride,degree=2,distance=4,table=64".
+ * @throws std::invalid_argument on unknown keys or malformed values.
+ */
+inline PrefetcherConfig parse_prefetcher_config(const std::string &spec,
+                                                PrefetcherConfig base) {
+  parse_config_options(spec, [&](const std::string &key,
+                                  const std::string &value) {
+    if (key == "type") {
+      if (value == "nextline") {
+        base.type = PrefetcherType::NextLine;
+      } else if (value == "stride") {
+        base.type = PrefetcherType::Stride;
+      } else {
+        throw std::invalid_argument("unknown prefetcher type: " + value);
+      }
+    } else if (key == "degree") {
+      base.degree = parse_config_number(key, value);
+    } else if (key == "distance") {
+      base.distance = parse_config_number(key, value);
+    } else if (key == "table") {
+      base.table_size = parse_config_number(key, value);
+    } else {
+      throw std::invalid_argument("unknown prefetcher option: " + key);
+    }
+  });
+  base.validate();
+  return base;
+}
+
+/**
+ * @brief Interface of a cache prefetcher.
+ *
+ * The cache reports every demand access; the prefetcher answers with the
+ * addresses it wants brought in. Whether a request is worth issuing (the
+ * line may already be cached) is left to the cache.
+ */
+class Prefetcher {
+public:
+  virtual ~Prefetcher() = default;
+
+  /**
+   * @brief Observes a demand access and appends prefetch addresses to out.
+   * @param pc Address of the instruction making the access.
+   * @param address The first byte accessed.
+   * @param trigger Whether the access missed or was the first use of a
+   * prefetched line.
+   */
+  virtual void observe(uint32_t pc, uint32_t address, bool trigger,
+                       std::vector<uint32_t> &out) = 0;
+
+  virtual std::string describe() const = 0;
+};
+
+/**
+ * @brief Fetches the lines following a missing or newly useful line.
+ */
+class NextLinePrefetcher : public Prefetcher {
+  PrefetcherConfig config;
+  uint32_t line_size;
+
+public:
+  NextLinePrefetcher(const PrefetcherConfig &config, uint32_t line_size)
+      : config(config), line_size(line_size) {}
+
+  void observe(uint32_t, uint32_t address, bool trigger,
+               std::vector<uint32_t> &out) override {
+    if (!trigger) {
+      return;
+    }
+    uint32_t line = address & ~(line_size - 1);
+    for (uint32_t i = 0; i < config.degree; i++) {
+      out.push_back(line + (config.distance + i) * line_size);
+    }
+  }
+
+  std::string describe() const override {
+    return "next-line, degree " + std::to_string(config.degree) +
+           ", distance " + std::to_string(config.distance);
+  }
+};
+
+/**
+ * @brief Per-instruction stride detector.
+ *
+ * A direct-mapped table indexed by PC remembers the last address and stride
+ * of each load or store. Once the same non-zero stride has been seen twice
+ * in a row, every access requests the addresses distance to
+ * distance + degree - 1 strides ahead.
+ */
+class StridePrefetcher : public Prefetcher {
+  struct Entry {
+    uint32_t pc = 0;
+    uint32_t last_address = 0;
+    int32_t stride = 0;
+    uint8_t confidence = 0; // saturating, 0-3
+    bool valid = false;
+  };
+
+  PrefetcherConfig config;
+  std::vector<Entry> table;
+
+public:
+  explicit StridePrefetcher(const PrefetcherConfig &config)
+      : config(config), table(config.table_size) {}
+
+  void observe(uint32_t pc, uint32_t address, bool,
+               std::vector<uint32_t> &out) override {
+    Entry &entry = table[(pc >> 2) & (config.table_size - 1)];
+    if (!entry.valid || entry.pc != pc) {
+      entry = Entry{pc, address, 0, 0, true};
+      return;
+    }
+
+    int32_t stride = static_cast<int32_t>(address - entry.last_address);
+    entry.last_address = address;
+    if (stride == entry.stride) {
+      if (entry.confidence < 3) {
+        entry.confidence++;
+      }
+    } else if (entry.confidence > 0) {
+      entry.confidence--;
+    } else {
+      entry.stride = stride;
+    }
+
+    if (entry.confidence >= 2 && entry.stride != 0) {
+      for (uint32_t i = 0; i < config.degree; i++) {
+        out.push_back(address + static_cast<uint32_t>(entry.stride) *
+                                    (config.distance + i));
+      }
+    }
+  }
+
+  std::string describe() const override {
+    return "stride, degree " + std::to_string(config.degree) +
+           ", distance " + std::to_string(config.distance) + ", " +
+           std::to_string(config.table_size) + " entries";
+  }
+};
+
+inline std::unique_ptr<Prefetcher>
+make_prefetcher(const PrefetcherConfig &config, uint32_t line_size) {
+  switch (config.type) {
+  case PrefetcherType::NextLine:
+    return std::make_unique<NextLinePrefetcher>(config, line_size);
+  default:
+    return std::make_unique<StridePrefetcher>(config);
+  }
+}
+
+#endif // CORE_PREFETCHER_HPP
@@ -6,6 +6,9 @@
 #include <cstdint>
 #include <limits>
 
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::REGFILE
+
 class RegisterFile {
 public:
   RegisterFile();
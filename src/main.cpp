@@ -1,31 +1,374 @@
-// #define LOGGING_LEVEL_INFO
-// #define LOGGING_LEVEL_DEBUG
-#define LOGGING_LEVEL_NONE
 #include "core/cpu.hpp"
+#include "utils/binary_loader.hpp"
+#include "utils/commit_trace.hpp"
+#include "utils/konata.hpp"
 #include "utils/logger.hpp"
+#include "utils/trace.hpp"
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::MAIN
 
 int main(int argc, char* argv[]) {
   std::ios::sync_with_stdio(false);
   std::cin.tie(nullptr);
   std::cout.tie(nullptr);
 
+  // Usage:
+  //   code [options] [program]         run a hex or binary image (or stdin)
+  //   code --convert <in.data> <out>   precompile hex text to a binary image
+  //   code --decode-trace <trace> [--csv|--konata]
+  //                                    print a --trace file as text, CSV or
+  //                                    a Konata pipeline view
+  //   code --decode-commits <trace>    print a --commit-trace file as a
+  //                                    register dump, one line per commit
+  // Options:
+  //   --image-cache         reuse/write <program>.rvimg
+  //   --speculative-loads   issue loads past unresolved store addresses
+  //   --load-ports <n>      loads the memory unit starts per cycle
+  //   --store-ports <n>     store buffer entries drained per cycle
+  //   --store-buffer <n>    post-commit store buffer entries (8)
+  //   --store-buffer-block <n>
+  //                         bytes each store buffer entry combines (64)
+  //   --mem-latency <n>     memory access latency in cycles without an L1D
+  //   --l1d <spec>|on|off   L1 data cache, e.g. size=32K,assoc=8,line=64,
+  //                         repl=lru|plru|random,write=back|through,
+  //                         alloc=yes|no,hit=3,miss=20,mshrs=8 (off)
+  //   --l1i <spec>|on|off   L1 instruction cache, same spec as --l1d (off)
+  //   --prefetch <spec>|on|off
+  //                         L1D prefetcher, e.g. type=stride|nextline,
+  //                         degree=2,distance=1,table=64 (off)
+  //   --l2 <spec>|on|off    unified L2 cache behind the L1s, same spec as
+  //                         --l1d (off)
+  //   --dram <spec>|on|off  DRAM banks and timing behind the last cache,
+  //                         e.g. banks=8,row=2K,trcd=42,tcas=42,trp=42,
+  //                         ctrl=30 (off)
+  //   --fetch-block <n>     bytes fetched per cycle, a power of two (16)
+  //   --fetch-buffer <n>    decoded instructions buffered ahead of issue (8)
+  //   --issue-width <n>     instructions issued per cycle (1)
+  //   --commit-width <n>    instructions retired per cycle (1)
+  //   --alus <n>            unpipelined integer ALUs (1)
+  //   --alu-latency <n>     cycles an ALU spends on an instruction (2)
+  //   --branch-units <n>    pipelined branch units (1)
+  //   --branch-latency <n>  cycles from branch dispatch to its result (2)
+  //   --stats               print cycle and cache counters to stderr at exit
+  //   --log-level <level>   none|error|warn|info|debug (none)
+  //   --log-modules <list>  only log these modules, e.g. rob,lsb (all)
+  //   --log-start <cycle>   keep logging off until this cycle
+  //   --trace <file>        record pipeline events to a binary trace
+  //   --commit-trace <file> record the registers after every commit
+  //   --cosim               check every commit against a functional model
+  //                         running on a second thread
+  CPUConfig config;
+  bool print_stats = false;
+  bool use_cosim = false;
+  Logger::Level log_level = Logger::Level::NONE;
+  uint32_t log_start = 0;
+  std::string trace_path;
+  std::string commit_trace_path;
+  std::string filename;
+  // Parses the positive integer following option argv[i].
+  auto count_arg = [&](int &i, uint32_t &value) {
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << argv[i] << std::endl;
+      return false;
+    }
+    try {
+      long parsed = std::stol(argv[i + 1]);
+      if (parsed <= 0) {
+        throw std::out_of_range("non-positive");
+      }
+      value = static_cast<uint32_t>(parsed);
+    } catch (const std::exception &) {
+      std::cerr << "Invalid value for " << argv[i] << ": " << argv[i + 1]
+                << std::endl;
+      return false;
+    }
+    ++i;
+    return true;
+  };
+  // Parses the spec following option argv[i] into level, starting from base
+  // when the level was switched off; "on" enables it with those defaults.
+  auto level_arg = [&](int &i, auto &level, const auto &base, auto parse) {
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << argv[i] << std::endl;
+      return false;
+    }
+    std::string spec = argv[i + 1];
+    if (spec == "off") {
+      level.reset();
+    } else if (spec == "on") {
+      level = level.value_or(base);
+    } else {
+      try {
+        level = parse(spec, level.value_or(base));
+      } catch (const std::invalid_argument &e) {
+        std::cerr << "Invalid " << argv[i] << ": " << e.what() << std::endl;
+        return false;
+      }
+    }
+    ++i;
+    return true;
+  };
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--load-ports") {
+      if (!count_arg(i, config.lsb.load_ports)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--store-ports") {
+      if (!count_arg(i, config.lsb.store_ports)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--store-buffer") {
+      if (!count_arg(i, config.lsb.store_buffer_size)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--store-buffer-block") {
+      if (!count_arg(i, config.lsb.store_buffer_block)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--mem-latency") {
+      if (!count_arg(i, config.lsb.latency)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--l1d") {
+      if (!level_arg(i, config.l1d, CacheConfig{}, parse_cache_config)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--l1i") {
+      if (!level_arg(i, config.l1i, CacheConfig{}, parse_cache_config)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--prefetch") {
+      if (!level_arg(i, config.l1d_prefetcher, PrefetcherConfig{},
+                     parse_prefetcher_config)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--l2") {
+      if (!level_arg(i, config.l2, default_l2_config(), parse_cache_config)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--dram") {
+      if (!level_arg(i, config.dram, DRAMConfig{}, parse_dram_config)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--fetch-block") {
+      if (!count_arg(i, config.fetch_block_size)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--fetch-buffer") {
+      if (!count_arg(i, config.fetch_buffer_size)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--issue-width") {
+      if (!count_arg(i, config.issue_width)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--commit-width") {
+      if (!count_arg(i, config.commit_width)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--alus") {
+      if (!count_arg(i, config.alu.count)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--alu-latency") {
+      if (!count_arg(i, config.alu.latency)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--branch-units") {
+      if (!count_arg(i, config.branch.count)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--branch-latency") {
+      if (!count_arg(i, config.branch.latency)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--stats") {
+      print_stats = true;
+    } else if (arg == "--cosim") {
+      use_cosim = true;
+    } else if (arg == "--log-level" || arg == "--log-modules") {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << arg << std::endl;
+        return EXIT_FAILURE;
+      }
+      try {
+        if (arg == "--log-level") {
+          log_level = Logger::parseLevel(argv[++i]);
+        } else {
+          Logger::setModules(Logger::parseModules(argv[++i]));
+        }
+      } catch (const std::invalid_argument &e) {
+        std::cerr << "Invalid " << arg << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--log-start") {
+      if (!count_arg(i, log_start)) {
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "--trace" || arg == "--commit-trace") {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << arg << std::endl;
+        return EXIT_FAILURE;
+      }
+      if (arg == "--trace") {
+        trace_path = argv[++i];
+      } else {
+        commit_trace_path = argv[++i];
+      }
+    } else if (arg == "--image-cache") {
+      config.use_image_cache = true;
+    } else if (arg == "--speculative-loads") {
+      config.lsb.speculative_loads = true;
+    } else if (arg == "--convert") {
+      if (i + 2 >= argc) {
+        std::cerr << "Usage: " << argv[0] << " --convert <input> <output>"
+                  << std::endl;
+        return EXIT_FAILURE;
+      }
+      try {
+        Memory memory;
+        BinaryLoader loader(memory, argv[i + 1]);
+        loader.save_image(argv[i + 2]);
+      } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+      }
+      return EXIT_SUCCESS;
+    } else if (arg == "--decode-trace") {
+      if (i + 1 >= argc) {
+        std::cerr << "Usage: " << argv[0]
+                  << " --decode-trace <trace> [--csv|--konata]" << std::endl;
+        return EXIT_FAILURE;
+      }
+      std::string format = i + 2 < argc ? argv[i + 2] : "";
+      try {
+        if (format == "--konata") {
+          write_konata(argv[i + 1], std::cout);
+        } else {
+          decode_trace(argv[i + 1], std::cout, format == "--csv");
+        }
+      } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+      }
+      return EXIT_SUCCESS;
+    } else if (arg == "--decode-commits") {
+      if (i + 1 >= argc) {
+        std::cerr << "Usage: " << argv[0] << " --decode-commits <trace>"
+                  << std::endl;
+        return EXIT_FAILURE;
+      }
+      try {
+        decode_commit_trace(argv[i + 1], std::cout);
+      } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+      }
+      return EXIT_SUCCESS;
+    } else {
+      filename = arg;
+    }
+  }
+  if (config.fetch_block_size < 4 ||
+      (config.fetch_block_size & (config.fetch_block_size - 1)) != 0) {
+    std::cerr << "--fetch-block must be a power of two of at least 4"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  uint32_t block = config.lsb.store_buffer_block;
+  if (block > 64 || (block & (block - 1)) != 0) {
+    std::cerr << "--store-buffer-block must be a power of two of at most 64"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  // a misaligned word store can touch ceil(4 / block) + 1 blocks
+  uint32_t store_span = (4 + block - 1) / block + 1;
+  if (config.lsb.store_buffer_size < store_span) {
+    std::cerr << "--store-buffer must hold at least " << store_span
+              << " entries with " << block << "-byte blocks" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (config.fetch_buffer_size < config.fetch_block_size / 4) {
+    std::cerr << "--fetch-buffer must hold at least one fetch block"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (log_start > 0) {
+    Logger::setLevelFrom(log_level, log_start);
+  } else {
+    Logger::setLevel(log_level);
+  }
   LOG_INFO("RISC-V Simulator starting...");
 
+  // use stdin when no file is given
+  auto cpu = filename.empty() ? std::make_unique<CPU>(config)
+                              : std::make_unique<CPU>(filename, config);
+  std::unique_ptr<TraceWriter> trace;
+  if (!trace_path.empty()) {
+    try {
+      trace = std::make_unique<TraceWriter>(trace_path);
+    } catch (const std::runtime_error &e) {
+      std::cerr << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    cpu->set_tracer(trace.get());
+  }
+  std::unique_ptr<CommitTraceWriter> commit_trace;
+  if (!commit_trace_path.empty()) {
+    try {
+      commit_trace = std::make_unique<CommitTraceWriter>(commit_trace_path);
+    } catch (const std::runtime_error &e) {
+      std::cerr << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    cpu->set_commit_trace(commit_trace.get());
+  }
+  std::unique_ptr<CoSimulator> cosim;
+  if (use_cosim) {
+    cosim = std::make_unique<CoSimulator>(
+        cpu->get_memory(), cpu->get_entry_point(), cpu->get_symbols());
+    cpu->set_cosim(cosim.get());
+  }
+  LOG_INFO("Starting CPU execution");
   int result;
-  if (argc > 1) {
-    CPU cpu(argv[1]);
-    LOG_INFO("Starting CPU execution");
-    result = cpu.run();
-  } else {
-    // use stdin
-    CPU cpu;
-    LOG_INFO("Starting CPU execution");
-    result = cpu.run();
+  try {
+    result = cpu->run();
+  } catch (const CoSimulationMismatch &e) {
+    std::cerr << e.what();
+    return EXIT_FAILURE;
+  }
+  if (cosim && !cosim->finish()) {
+    std::cerr << cosim->get_mismatch();
+    return EXIT_FAILURE;
+  }
+  if (print_stats) {
+    cpu->print_stats(std::cerr);
+  }
+  if (trace) {
+    cpu->set_tracer(nullptr);
+    if (!trace->close()) {
+      std::cerr << "Failed to write trace file: " << trace_path << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (commit_trace) {
+    cpu->set_commit_trace(nullptr);
+    if (!commit_trace->close()) {
+      std::cerr << "Failed to write commit trace: " << commit_trace_path
+                << std::endl;
+      return EXIT_FAILURE;
+    }
   }
 
-  LOG_INFO("CPU execution completed with result: " + std::to_string(result));
+  LOG_INFO("CPU execution completed with result: {}", result);
   std::cout << (result & 0xFF) << std::endl;
 
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -2,18 +2,26 @@
 #define TOMASULO_REORDER_BUFFER_HPP
 
 #include "../core/alu.hpp"
+#include "../core/cosim.hpp"
 #include "../core/memory.hpp"
 #include "../core/predictor.hpp"
 #include "../core/register_file.hpp"
 #include "../riscv/instruction.hpp"
+#include "../utils/commit_trace.hpp"
+#include "../utils/dump.hpp"
 #include "../utils/exceptions.hpp"
 #include "../utils/logger.hpp"
 #include "../utils/queue.hpp"
+#include "../utils/trace.hpp"
 #include "reservation_station.hpp"
 #include <array>
 #include <cstdint>
 #include <optional>
 #include <variant>
+#include <vector>
+
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::ROB
 
 struct ReorderBufferEntry {
   ReorderBufferEntry() = default;
@@ -40,23 +48,27 @@ struct ReorderBufferEntry {
 };
 
 class ReorderBuffer {
+  enum class CommitResult { Stalled, Committed, Flushed };
+
   CircularQueue<ReorderBufferEntry> rob;
   uint32_t cur_id = 0;
+  uint32_t commit_width; // entries retired per cycle
+  uint64_t committed_count = 0;
   RegisterFile &reg_file;
-  ALU &alu;
-  Predictor &predictor;
+  std::vector<Predictor> &branch_units;
   LSB &mem;
   ReservationStation &rs;
-  // norb::RegisterDumper<32> reg_dumper;
+  TraceWriter *tracer = nullptr;
+  CommitTraceWriter *commit_trace = nullptr;
+  CoSimulator *cosim = nullptr;
 
 public:
-  ReorderBuffer(RegisterFile &reg_file, ALU &alu, Predictor &predictor,
-                LSB &mem, ReservationStation &rs);
+  ReorderBuffer(RegisterFile &reg_file, std::vector<Predictor> &branch_units,
+                LSB &mem, ReservationStation &rs, uint32_t commit_width = 1);
 
   int add_entry(riscv::DecodedInstruction instr,
                 std::optional<uint32_t> dest_tag, uint32_t instr_pc);
   bool commit(uint32_t &pc);
-  void receive_broadcast();
   void receive_alu_result(const ALUResult &result);
   void receive_memory_result(const MemoryResult &result);
   void receive_predictor_result(const PredictorResult &result);
@@ -64,15 +76,22 @@ public:
   std::optional<int32_t> get_value(std::optional<uint32_t> rob_id);
   // void print_debug_info();
   bool isFull() const;
+  uint64_t get_committed_count() const { return committed_count; }
+  std::optional<uint32_t> get_pc(uint32_t rob_id) const;
+  void set_tracer(TraceWriter *writer) { tracer = writer; }
+  void set_commit_trace(CommitTraceWriter *writer) { commit_trace = writer; }
+  void set_cosim(CoSimulator *checker) { cosim = checker; }
+
+private:
+  CommitResult commit_head(uint32_t &pc);
 };
 
-inline ReorderBuffer::ReorderBuffer(RegisterFile &reg_file, ALU &alu,
-                                    Predictor &predictor, LSB &mem,
-                                    ReservationStation &rs)
-    : rob(32), reg_file(reg_file), alu(alu), predictor(predictor), mem(mem),
-      rs(rs)
-// , reg_dumper("register_dump.txt")
-{
+inline ReorderBuffer::ReorderBuffer(RegisterFile &reg_file,
+                                    std::vector<Predictor> &branch_units,
+                                    LSB &mem, ReservationStation &rs,
+                                    uint32_t commit_width)
+    : rob(32), commit_width(commit_width), reg_file(reg_file),
+      branch_units(branch_units), mem(mem), rs(rs) {
   LOG_DEBUG("ReorderBuffer initialized with capacity: 32");
 }
 
@@ -83,28 +102,72 @@ inline int ReorderBuffer::add_entry(riscv::DecodedInstruction instr,
     ReorderBufferEntry ent(instr, dest_tag, cur_id++);
     ent.instruction_pc = instr_pc;
     rob.enqueue(ent);
-    LOG_DEBUG("Added entry to ROB with ID: " + std::to_string(ent.id) +
-              (dest_tag.has_value()
-                   ? ", dest_reg: " + std::to_string(dest_tag.value())
-                   : ", no dest_reg"));
+    if (dest_tag.has_value()) {
+      LOG_DEBUG("Added entry to ROB with ID: {}, dest_reg: {}", ent.id,
+                dest_tag.value());
+    } else {
+      LOG_DEBUG("Added entry to ROB with ID: {}, no dest_reg", ent.id);
+    }
     return ent.id;
   }
   LOG_WARN("ROB is full, cannot add new entry");
   return -1;
 }
 
+/**
+ * @brief Commit stage: retires up to commit_width consecutive entries from
+ * the head, in order. Stops at the first entry that is not ready or whose
+ * store finds the store buffer full, and after a misprediction or replay.
+ * @return true if the pipeline was flushed; pc is then where fetch restarts.
+ */
 inline bool ReorderBuffer::commit(uint32_t &pc) {
+  for (uint32_t slot = 0; slot < commit_width; slot++) {
+    CommitResult result = commit_head(pc);
+    if (result != CommitResult::Committed) {
+      return result == CommitResult::Flushed;
+    }
+  }
+  return false;
+}
+
+inline ReorderBuffer::CommitResult ReorderBuffer::commit_head(uint32_t &pc) {
   if (rob.isEmpty()) {
     LOG_DEBUG("ROB is empty, nothing to commit");
-    return false;
+    return CommitResult::Stalled;
   }
 
   const auto &ent = rob.front();
 
-  mem.commit_memory(ent.id);
+  // A load that read stale data past a store it turned out to alias is
+  // squashed together with everything after it and fetched again.
+  if (ent.ready && mem.requires_replay(ent.id)) {
+    LOG_WARN("Memory ordering violation detected! Replaying load at PC: {}",
+             norb::hex(ent.instruction_pc));
+    pc = ent.instruction_pc;
+    if (tracer) {
+      tracer->record(TraceEvent::Flush, ent.id, ent.instruction_pc, pc);
+    }
+    flush();
+    rs.flush();
+    mem.flush();
+    for (Predictor &unit : branch_units) {
+      unit.flush();
+    }
+    return CommitResult::Flushed;
+  }
+
+  if (ent.ready && !mem.can_commit(ent.id)) {
+    LOG_DEBUG("Store buffer full, commit stalled for ROB ID: {}", ent.id);
+    return CommitResult::Stalled;
+  }
 
   if (ent.ready) {
-    LOG_DEBUG("Committing instruction with ROB ID: " + std::to_string(ent.id));
+    LOG_DEBUG("Committing instruction with ROB ID: {}", ent.id);
+    mem.commit_memory(ent.id);
+    if (tracer) {
+      tracer->record(TraceEvent::Commit, ent.id, ent.instruction_pc,
+                     ent.dest_tag.has_value() ? ent.value : 0);
+    }
 
     // termination instruction: li a0, 255
     if (auto *i_instr = std::get_if<riscv::I_Instruction>(&ent.instr)) {
@@ -116,15 +179,16 @@ inline bool ReorderBuffer::commit(uint32_t &pc) {
 
         // Get the original value of a0 before termination
         double original_a0_value = reg_file.read(10);
-        LOG_INFO("Program terminating with exit code: " +
-                 std::to_string(static_cast<int>(original_a0_value)));
+        LOG_INFO("Program terminating with exit code: {}",
+                 static_cast<int>(original_a0_value));
 
         // Do not write to register a0, just mark it as available if needed
         if (ent.dest_tag.has_value() &&
             reg_file.get_rob(ent.dest_tag.value()) == ent.id) {
           reg_file.mark_available(ent.dest_tag.value());
-          LOG_DEBUG("Marked register " + std::to_string(ent.dest_tag.value()) +
-                    " as available without overwriting its value");
+          LOG_DEBUG(
+              "Marked register {} as available without overwriting its value",
+              ent.dest_tag.value());
         }
 
         throw ProgramTerminationException(static_cast<int>(original_a0_value));
@@ -139,133 +203,64 @@ inline bool ReorderBuffer::commit(uint32_t &pc) {
       flush();
       rs.flush();
       mem.flush();
-      predictor.flush();
+      for (Predictor &unit : branch_units) {
+        unit.flush();
+      }
       pc = ent.pc;
+      if (tracer) {
+        tracer->record(TraceEvent::Flush, ent.id, ent.instruction_pc, pc);
+      }
     } else {
       LOG_DEBUG("No predictor broadcast available");
     }
 
     if (ent.dest_tag.has_value()) {
-      LOG_DEBUG("Writing value " + std::to_string(ent.value) + " to register " +
-                std::to_string(ent.dest_tag.value()));
+      LOG_DEBUG("Writing value {} to register {}", ent.value,
+                ent.dest_tag.value());
       reg_file.write(ent.dest_tag.value(), ent.value);
       if (reg_file.get_rob(ent.dest_tag.value()) == ent.id) {
         reg_file.mark_available(ent.dest_tag.value());
-        LOG_DEBUG("Marked register " + std::to_string(ent.dest_tag.value()) +
-                  " as available");
+        LOG_DEBUG("Marked register {} as available", ent.dest_tag.value());
       }
     }
 
-    // Dump register file contents after commit
-    std::array<uint32_t, 32> reg_snapshot;
-    for (size_t i = 0; i < 32; ++i) {
-      reg_snapshot[i] = static_cast<uint32_t>(reg_file.read(i));
+    if (commit_trace || cosim) {
+      uint32_t value =
+          ent.dest_tag ? static_cast<uint32_t>(reg_file.read(*ent.dest_tag))
+                       : 0;
+      if (commit_trace) {
+        commit_trace->record(ent.instruction_pc, ent.dest_tag, value);
+      }
+      if (cosim) {
+        cosim->record(ent.instruction_pc, ent.dest_tag, value);
+      }
     }
-    // reg_dumper.dump(ent.instruction_pc, reg_snapshot);
 
     rob.dequeue();
+    committed_count++;
     LOG_DEBUG("Instruction committed and removed from ROB");
 
-    return ent.exception_flag;
+    return ent.exception_flag ? CommitResult::Flushed
+                              : CommitResult::Committed;
   } else {
-    LOG_DEBUG("Head instruction not ready for commit (ROB ID: " +
-              std::to_string(ent.id) +
-              "), instruction details: " + riscv::to_string(ent.instr));
-  }
-
-  return false; // No misprediction if instruction wasn't ready
-}
-
-inline void ReorderBuffer::receive_broadcast() {
-  LOG_DEBUG("Checking for broadcast results from execution units");
-  int broadcasts_received = 0;
-
-  // check ALU, Predictor, and LSB
-  if (alu.has_result_for_broadcast()) {
-    ALUResult result = alu.get_result_for_broadcast();
-    LOG_DEBUG(
-        "Received ALU broadcast for tag: " + std::to_string(result.dest_tag) +
-        ", result: " + std::to_string(result.result));
-    for (int i = 0; i < rob.size(); i++) {
-      ReorderBufferEntry &ent = rob.get(i);
-      if (ent.id == result.dest_tag) {
-        ent.value = result.result;
-        ent.ready = true;
-        rs.receive_broadcast(result.result, result.dest_tag);
-        LOG_DEBUG("Updated ROB entry ID: " + std::to_string(ent.id) +
-                  " with ALU result");
-        broadcasts_received++;
-      }
-    }
-  }
-  if (predictor.has_result_for_broadcast()) {
-    PredictorResult result = predictor.get_result_for_broadcast();
-    LOG_DEBUG("Received Predictor broadcast, PC: " + std::to_string(result.pc));
-    for (int i = 0; i < rob.size(); i++) {
-      ReorderBufferEntry &ent = rob.get(i);
-      if (result.dest_tag.has_value() && ent.id == result.dest_tag.value()) {
-        ent.value = result.pc;
-        ent.pc = result.correct_target;
-        ent.ready = true;
-        rs.receive_broadcast(result.pc, result.dest_tag.value());
-        ent.exception_flag = result.is_mispredicted;
-        // ent.value = result.correct_target;
-        LOG_DEBUG("Updated ROB entry ID: " + std::to_string(ent.id) +
-                  " with Predictor result (return addr: " +
-                  std::to_string(result.pc) + ")");
-        broadcasts_received++;
-      } else if (ent.id == result.rob_id) {
-        // B type
-        ent.ready = true;
-        ent.exception_flag = result.is_mispredicted;
-        ent.pc = result.correct_target;
-        LOG_DEBUG("Updated ROB entry ID: " + std::to_string(ent.id) +
-                  " as ready based on Predictor result");
-        broadcasts_received++;
-      }
-    }
-  }
-  if (mem.has_result_for_broadcast()) {
-    MemoryResult result = mem.get_result_for_broadcast();
-    // Only LOAD operations update the ROB. A STORE completion broadcast is
-    // informational and arrives after the instruction has already been
-    // committed and removed from the ROB.
-    if (result.is_load()) {
-      LOG_DEBUG("Received Memory broadcast for tag: " +
-                std::to_string(result.dest_tag) +
-                ", data: " + std::to_string(result.data));
-      for (int i = 0; i < rob.size(); i++) {
-        ReorderBufferEntry &ent = rob.get(i);
-        if (ent.id == result.dest_tag) {
-          ent.value = result.data;
-          ent.ready = true;
-          rs.receive_broadcast(result.data, result.dest_tag);
-          LOG_DEBUG("Updated ROB entry ID: " + std::to_string(ent.id) +
-                    " with Memory result");
-          broadcasts_received++;
-        }
-      }
-    }
+    LOG_DEBUG("Head instruction not ready for commit (ROB ID: {}), "
+              "instruction details: {}",
+              ent.id, riscv::to_string(ent.instr));
   }
 
-  if (broadcasts_received > 0) {
-    LOG_DEBUG("Processed " + std::to_string(broadcasts_received) +
-              " broadcasts this cycle");
-  }
+  return CommitResult::Stalled;
 }
 
 inline void ReorderBuffer::receive_alu_result(const ALUResult &result) {
-  LOG_DEBUG(
-      "Received ALU broadcast for tag: " + std::to_string(result.dest_tag) +
-      ", result: " + std::to_string(result.result));
+  LOG_DEBUG("Received ALU broadcast for tag: {}, result: {}", result.dest_tag,
+            result.result);
 
   for (int i = 0; i < rob.size(); i++) {
     ReorderBufferEntry &ent = rob.get(i);
     if (ent.id == result.dest_tag) {
       ent.value = result.result;
       ent.ready = true;
-      LOG_DEBUG("Updated ROB entry ID: " + std::to_string(ent.id) +
-                " with ALU result");
+      LOG_DEBUG("Updated ROB entry ID: {} with ALU result", ent.id);
       break;
     }
   }
@@ -274,17 +269,15 @@ inline void ReorderBuffer::receive_alu_result(const ALUResult &result) {
 inline void ReorderBuffer::receive_memory_result(const MemoryResult &result) {
   // Only LOAD operations update the ROB
   if (result.is_load()) {
-    LOG_DEBUG("Received Memory broadcast for tag: " +
-              std::to_string(result.dest_tag) +
-              ", data: " + std::to_string(result.data));
+    LOG_DEBUG("Received Memory broadcast for tag: {}, data: {}",
+              result.dest_tag, result.data);
 
     for (int i = 0; i < rob.size(); i++) {
       ReorderBufferEntry &ent = rob.get(i);
       if (ent.id == result.dest_tag) {
         ent.value = result.data;
         ent.ready = true;
-        LOG_DEBUG("Updated ROB entry ID: " + std::to_string(ent.id) +
-                  " with Memory result");
+        LOG_DEBUG("Updated ROB entry ID: {} with Memory result", ent.id);
         break;
       }
     }
@@ -293,26 +286,26 @@ inline void ReorderBuffer::receive_memory_result(const MemoryResult &result) {
 
 inline void
 ReorderBuffer::receive_predictor_result(const PredictorResult &result) {
-  LOG_DEBUG("Received Predictor broadcast, mispredicted=" +
-            std::to_string(result.is_mispredicted));
+  LOG_DEBUG("Received Predictor broadcast, mispredicted={}",
+            result.is_mispredicted);
 
   for (int i = 0; i < rob.size(); i++) {
     ReorderBufferEntry &ent = rob.get(i);
     if (result.dest_tag.has_value() && ent.id == result.dest_tag.value()) {
-      ent.value = result.pc;
+      ent.value = result.return_address;
       ent.pc = result.correct_target;
       ent.ready = true;
       ent.exception_flag = result.is_mispredicted;
-      LOG_DEBUG("Updated ROB entry ID: " + std::to_string(ent.id) +
-                " with Predictor result (return addr: " +
-                std::to_string(result.pc) + ")");
+      LOG_DEBUG(
+          "Updated ROB entry ID: {} with Predictor result (return addr: {})",
+          ent.id, result.return_address);
     } else if (ent.id == result.rob_id) {
       // B type
       ent.ready = true;
       ent.exception_flag = result.is_mispredicted;
       ent.pc = result.correct_target;
-      LOG_DEBUG("Updated ROB entry ID: " + std::to_string(ent.id) +
-                " as ready based on Predictor result");
+      LOG_DEBUG("Updated ROB entry ID: {} as ready based on Predictor result",
+                ent.id);
     }
   }
 }
@@ -325,8 +318,8 @@ inline void ReorderBuffer::flush() {
     if (ent.dest_tag.has_value()) {
       if (reg_file.get_rob(ent.dest_tag.value()) == ent.id) {
         reg_file.mark_available(ent.dest_tag.value());
-        LOG_DEBUG("Cleared register dependency for reg" +
-                  std::to_string(ent.dest_tag.value()));
+        LOG_DEBUG("Cleared register dependency for reg{}",
+                  ent.dest_tag.value());
       }
     }
     rob.dequeue();
@@ -350,14 +343,27 @@ ReorderBuffer::get_value(std::optional<uint32_t> rob_id) {
       if (ent.ready) {
         return static_cast<int32_t>(ent.value);
       } else {
-        LOG_DEBUG("ROB entry ID: " + std::to_string(id) +
-                  " is not ready, cannot retrieve value");
+        LOG_DEBUG("ROB entry ID: {} is not ready, cannot retrieve value", id);
         return std::nullopt;
       }
     }
   }
-  LOG_DEBUG("ROB entry ID: " + std::to_string(id) +
-            " not found, returning nullopt");
+  LOG_DEBUG("ROB entry ID: {} not found, returning nullopt", id);
+  return std::nullopt;
+}
+
+/**
+ * @brief Looks up the address of the instruction holding a ROB entry.
+ * @return nullopt if the entry has already left the ROB.
+ */
+inline std::optional<uint32_t>
+ReorderBuffer::get_pc(uint32_t rob_id) const {
+  for (int i = 0; i < rob.size(); i++) {
+    const auto &ent = rob.get(i);
+    if (ent.id == rob_id) {
+      return ent.instruction_pc;
+    }
+  }
   return std::nullopt;
 }
 
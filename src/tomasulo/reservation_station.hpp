@@ -8,6 +8,9 @@
 #include <limits>
 #include <optional>
 
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::RS
+
 struct ReservationStationEntry {
   ReservationStationEntry() = default;
   ReservationStationEntry(riscv::DecodedInstruction op, uint32_t qj,
@@ -32,6 +35,7 @@ public:
                  int dest_tag, uint32_t pc = 0);
   void receive_broadcast(int32_t value, uint32_t dest_tag);
   void flush();
+  bool is_full() const { return rs.isFull(); }
   // void print_debug_info();
 };
 
@@ -46,15 +50,14 @@ inline void ReservationStation::add_entry(const riscv::DecodedInstruction &op,
                                           int dest_tag, uint32_t pc) {
   if (!rs.isFull()) {
     LOG_DEBUG(
-        "Adding pre-processed entry to Reservation Station with dest_tag: " +
-        std::to_string(dest_tag));
+        "Adding pre-processed entry to Reservation Station with dest_tag: {}",
+        dest_tag);
 
     ReservationStationEntry ent(op, qj, qk, vj, vk, imm.value_or(0), dest_tag,
                                 pc);
 
     rs.enqueue(ent);
-    LOG_DEBUG("Entry added successfully. qj=" + std::to_string(qj) +
-              ", qk=" + std::to_string(qk));
+    LOG_DEBUG("Entry added successfully. qj={}, qk={}", qj, qk);
   } else {
     LOG_WARN("Reservation Station is full, cannot add new entry");
   }
@@ -62,8 +65,7 @@ inline void ReservationStation::add_entry(const riscv::DecodedInstruction &op,
 
 inline void ReservationStation::receive_broadcast(int32_t value,
                                                   uint32_t dest_tag) {
-  LOG_DEBUG("Receiving broadcast for tag: " + std::to_string(dest_tag) +
-            ", value: " + std::to_string(value));
+  LOG_DEBUG("Receiving broadcast for tag: {}, value: {}", dest_tag, value);
   int updated_entries = 0;
 
   for (int i = 0; i < rs.size(); i++) {
@@ -73,13 +75,13 @@ inline void ReservationStation::receive_broadcast(int32_t value,
     if (ent.qj == dest_tag) {
       ent.vj = value;
       ent.qj = std::numeric_limits<uint32_t>::max();
-      LOG_DEBUG("Updated operand vj for RS entry " + std::to_string(i));
+      LOG_DEBUG("Updated operand vj for RS entry {}", i);
       updated = true;
     }
     if (ent.qk == dest_tag) {
       ent.vk = value;
       ent.qk = std::numeric_limits<uint32_t>::max();
-      LOG_DEBUG("Updated operand vk for RS entry " + std::to_string(i));
+      LOG_DEBUG("Updated operand vk for RS entry {}", i);
       updated = true;
     }
 
@@ -87,13 +89,13 @@ inline void ReservationStation::receive_broadcast(int32_t value,
       updated_entries++;
       if (ent.qj == std::numeric_limits<uint32_t>::max() &&
           ent.qk == std::numeric_limits<uint32_t>::max()) {
-        LOG_DEBUG("RS entry " + std::to_string(i) + " now ready for execution");
+        LOG_DEBUG("RS entry {} now ready for execution", i);
       }
     }
   }
 
-  LOG_DEBUG("Broadcast updated " + std::to_string(updated_entries) +
-            " reservation station entries");
+  LOG_DEBUG("Broadcast updated {} reservation station entries",
+            updated_entries);
 }
 
 inline void ReservationStation::flush() {
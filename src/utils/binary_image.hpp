@@ -0,0 +1,221 @@
+#ifndef UTILS_BINARY_IMAGE_HPP
+#define UTILS_BINARY_IMAGE_HPP
+
+#include "../core/memory.hpp"
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Precompiled program image.
+ *
+ * Layout (raw structs in host byte order; an image is a cache for the host
+ * that built it, not an interchange format):
+ *   ImageHeader
+ *   ImageSegment[segment_count]
+ *   segment data, each segment starting on an IMAGE_DATA_ALIGNMENT boundary
+ *
+ * Aligning segment data to host pages keeps every segment mmap-able on its
+ * own. source_hash holds hash_bytes() of the hex text the image was built
+ * from, so a cached image can be checked against its source before reuse.
+ */
+constexpr std::array<char, 8> IMAGE_MAGIC = {'R', 'V', 'S', 'I',
+                                             'M', 'I', 'M', 'G'};
+constexpr uint32_t IMAGE_VERSION = 1;
+constexpr uint64_t IMAGE_DATA_ALIGNMENT = 4096;
+
+struct ImageHeader {
+  std::array<char, 8> magic;
+  uint32_t version;
+  uint32_t segment_count;
+  uint64_t source_hash;
+  uint32_t entry_point;
+  uint32_t reserved;
+};
+
+struct ImageSegment {
+  uint32_t address;
+  uint32_t size;
+  uint64_t offset; // file offset of the segment data
+};
+
+static_assert(sizeof(ImageHeader) == 32, "ImageHeader layout changed");
+static_assert(sizeof(ImageSegment) == 16, "ImageSegment layout changed");
+
+/**
+ * @brief 64-bit content hash that consumes the input eight bytes at a time.
+ */
+inline uint64_t hash_bytes(const uint8_t *data, size_t size) {
+  constexpr uint64_t MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+  uint64_t hash = 0xCBF29CE484222325ULL ^ (size * MULTIPLIER);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * MULTIPLIER;
+    hash ^= hash >> 29;
+  }
+  for (; i < size; ++i) {
+    hash = (hash ^ data[i]) * MULTIPLIER;
+  }
+  hash ^= hash >> 32;
+  return hash;
+}
+
+/**
+ * @brief Private copy-on-write mapping of a whole file. Writes through data()
+ * stay in this process and never reach the file.
+ */
+class MappedFile {
+  uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  bool open_ = false;
+
+public:
+  /**
+   * @brief Maps the file at path. Check is_open() for success; an empty file
+   * opens successfully with a null data pointer.
+   */
+  explicit MappedFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    open_ = true;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *addr = ::mmap(nullptr, static_cast<size_t>(st.st_size),
+                          PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        data_ = static_cast<uint8_t *>(addr);
+        size_ = static_cast<size_t>(st.st_size);
+      } else {
+        open_ = false;
+      }
+    }
+    ::close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_) {
+      ::munmap(data_, size_);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool is_open() const { return open_; }
+  const uint8_t *data() const { return data_; }
+  uint8_t *data() { return data_; }
+  size_t size() const { return size_; }
+};
+
+/**
+ * @brief Checks whether a buffer starts with the image magic.
+ */
+inline bool is_binary_image(const uint8_t *data, size_t size) {
+  return size >= sizeof(ImageHeader) &&
+         std::memcmp(data, IMAGE_MAGIC.data(), IMAGE_MAGIC.size()) == 0;
+}
+
+/**
+ * @brief Validates an image and returns its header and segment table.
+ * @throws std::runtime_error if the image is truncated or malformed.
+ */
+inline std::vector<ImageSegment> read_image_segments(const uint8_t *data,
+                                                     size_t size,
+                                                     ImageHeader &header) {
+  if (!is_binary_image(data, size)) {
+    throw std::runtime_error("Not a binary program image");
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (header.version != IMAGE_VERSION) {
+    throw std::runtime_error("Unsupported binary image version: " +
+                             std::to_string(header.version));
+  }
+  size_t table_end = sizeof(ImageHeader) +
+                     static_cast<size_t>(header.segment_count) *
+                         sizeof(ImageSegment);
+  if (table_end > size) {
+    throw std::runtime_error("Truncated binary image segment table");
+  }
+  std::vector<ImageSegment> segments(header.segment_count);
+  std::memcpy(segments.data(), data + sizeof(ImageHeader),
+              segments.size() * sizeof(ImageSegment));
+  for (const auto &segment : segments) {
+    if (segment.offset > size || segment.size > size - segment.offset) {
+      throw std::runtime_error("Truncated binary image segment data");
+    }
+  }
+  return segments;
+}
+
+/**
+ * @brief Writes the given guest memory ranges to a binary image file.
+ * @param path Output file path.
+ * @param memory Guest memory holding the segment contents.
+ * @param ranges Segment addresses and sizes; offsets are assigned here.
+ * @param source_hash hash_bytes() of the source the image was built from.
+ * @param entry_point Initial PC of the program.
+ *
+ * The image is written to a temporary file beside path and renamed over it,
+ * so processes that have the old image mapped never see it truncated.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+inline void write_binary_image(const std::string &path, const Memory &memory,
+                               std::vector<ImageSegment> ranges,
+                               uint64_t source_hash, uint32_t entry_point) {
+  auto align = [](uint64_t value) {
+    return (value + IMAGE_DATA_ALIGNMENT - 1) & ~(IMAGE_DATA_ALIGNMENT - 1);
+  };
+
+  ImageHeader header{};
+  header.magic = IMAGE_MAGIC;
+  header.version = IMAGE_VERSION;
+  header.segment_count = static_cast<uint32_t>(ranges.size());
+  header.source_hash = source_hash;
+  header.entry_point = entry_point;
+
+  uint64_t offset =
+      align(sizeof(ImageHeader) + ranges.size() * sizeof(ImageSegment));
+  for (auto &range : ranges) {
+    range.offset = offset;
+    offset = align(offset + range.size);
+  }
+
+  std::string temp_path = path + ".tmp." + std::to_string(::getpid());
+  std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    throw std::runtime_error("Could not open image file for writing: " + path);
+  }
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(
+      reinterpret_cast<const char *>(ranges.data()),
+      static_cast<std::streamsize>(ranges.size() * sizeof(ImageSegment)));
+
+  std::vector<uint8_t> buffer;
+  for (const auto &range : ranges) {
+    file.seekp(static_cast<std::streamoff>(range.offset));
+    buffer.resize(range.size);
+    memory.read_block(range.address, buffer.data(), buffer.size());
+    file.write(reinterpret_cast<const char *>(buffer.data()),
+               static_cast<std::streamsize>(buffer.size()));
+  }
+  file.close();
+  if (!file || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+    throw std::runtime_error("Failed to write image file: " + path);
+  }
+}
+
+#endif // UTILS_BINARY_IMAGE_HPP
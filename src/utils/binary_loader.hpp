@@ -1,67 +1,73 @@
 #ifndef UTILS_BINARY_LOADER_HPP
 #define UTILS_BINARY_LOADER_HPP
 
+#include "../core/memory.hpp"
+#include "binary_image.hpp"
+#include "dump.hpp"
+#include "elf_loader.hpp"
 #include "logger.hpp"
+#include <array>
 #include <cstdint>
 #include <fstream>
 #include <iostream>
-#include <map>
-#include <sstream>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <vector>
+
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::LOADER
 
 class BinaryLoader {
 public:
   /**
    * @brief Constructs a BinaryLoader and loads the specified file.
+   *
+   * The file may be hex text, a precompiled binary image or an RV32 ELF
+   * executable. With
+   * use_image_cache set, hex text is first looked up in a sibling
+   * `<filename>.rvimg` cache, which is used only if its source hash matches
+   * and is (re)written after parsing otherwise.
+   * @param memory The guest memory shared by instruction fetch and the LSB.
    * @param filename The path to the file to load.
+   * @param use_image_cache Whether to read and write the image cache.
    */
-  BinaryLoader(const std::string &filename) {
-    LOG_INFO("Loading binary file: " + filename);
-    loadFile(filename);
+  BinaryLoader(Memory &memory, const std::string &filename,
+               bool use_image_cache = false)
+      : memory(memory) {
+    LOG_INFO("Loading binary file: {}", filename);
+    loadFile(filename, use_image_cache);
   }
 
   /**
    * @brief Constructs a BinaryLoader that will load data from stdin.
+   * @param memory The guest memory shared by instruction fetch and the LSB.
    */
-  BinaryLoader() { LOG_INFO("BinaryLoader created for stdin input"); }
+  explicit BinaryLoader(Memory &memory) : memory(memory) {
+    LOG_INFO("BinaryLoader created for stdin input");
+  }
 
   /**
    * @brief Fetches a 32-bit instruction from the loaded memory.
    * @param address The memory address of the instruction.
    * @return The 32-bit instruction word.
-   * @throws std::out_of_range if the address or the subsequent 3 bytes are not
-   * in memory.
+   * @throws std::out_of_range if the address or the subsequent 3 bytes lie in
+   * an unmapped page.
    */
   uint32_t fetchInstruction(uint32_t address) const {
-    std::stringstream ss;
-    ss << "0x" << std::hex << address;
-    LOG_DEBUG("Fetching instruction from memory address: " + ss.str() +
-              " (decimal: " + std::to_string(address) + ")");
-    try {
-      uint32_t byte0 = memory.at(address);
-      uint32_t byte1 = memory.at(address + 1);
-      uint32_t byte2 = memory.at(address + 2);
-      uint32_t byte3 = memory.at(address + 3);
-      uint32_t instruction =
-          byte0 | (byte1 << 8) | (byte2 << 16) | (byte3 << 24);
-      LOG_DEBUG("Fetched instruction: 0x" + std::to_string(instruction));
-      return instruction;
-    } catch (const std::out_of_range &e) {
-      LOG_ERROR("Memory access violation at address 0x" +
-                std::to_string(address));
+    LOG_DEBUG("Fetching instruction from memory address: {} (decimal: {})",
+              norb::hex(address), address);
+    if (!memory.is_mapped(address) || !memory.is_mapped(address + 3)) {
+      LOG_ERROR("Memory access violation at address {}", norb::hex(address));
       std::cerr << "Memory access violation at address 0x" << std::hex
                 << address << std::dec << std::endl;
-      throw;
+      throw std::out_of_range("Instruction fetch from unmapped address");
     }
+    uint32_t instruction = static_cast<uint32_t>(memory.read(address));
+    LOG_DEBUG("Fetched instruction: {}", norb::hex(instruction));
+    return instruction;
   }
 
-  /**
-   * @brief Gets a reference to the loaded memory data.
-   * @return Const reference to the memory map.
-   */
-  const std::map<uint32_t, uint8_t> &get_memory() const { return memory; }
-
   /**
    * @brief Loads binary data from stdin.
    */
@@ -70,77 +76,328 @@ public:
     loadFromStdin();
   }
 
+  /**
+   * @brief Writes the loaded program to a precompiled binary image.
+   * @param path The output file path.
+   * @throws std::runtime_error if the file cannot be written.
+   */
+  void save_image(const std::string &path) const {
+    write_binary_image(path, memory, segments, source_hash, entry_point);
+    LOG_INFO("Wrote binary image: {}", path);
+  }
+
+  /**
+   * @brief Gets the initial PC of the loaded program.
+   * @return The ELF or image entry point; 0 for hex text.
+   */
+  uint32_t get_entry_point() const { return entry_point; }
+
+  /**
+   * @brief Gets the ELF symbol table, sorted by address; empty for images
+   * and hex text.
+   */
+  const std::vector<ElfSymbol> &get_symbols() const { return symbols; }
+
+  static constexpr const char *IMAGE_CACHE_SUFFIX = ".rvimg";
+
 private:
-  std::map<uint32_t, uint8_t> memory;
+  static constexpr size_t READ_BLOCK_SIZE = 1 << 16;
+  static constexpr size_t SEGMENT_BUFFER_SIZE = 1 << 16;
+  static constexpr uint8_t NOT_HEX = 0xFF;
 
-  void loadFile(const std::string &filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-      LOG_ERROR("Could not open file: " + filename);
-      throw std::runtime_error("Could not open file: " + filename);
+  // Maps an input character to its hex digit value, or NOT_HEX.
+  static constexpr std::array<uint8_t, 256> HEX_TABLE = [] {
+    std::array<uint8_t, 256> table{};
+    table.fill(NOT_HEX);
+    for (int i = 0; i < 10; ++i) {
+      table['0' + i] = static_cast<uint8_t>(i);
+    }
+    for (int i = 0; i < 6; ++i) {
+      table['a' + i] = static_cast<uint8_t>(10 + i);
+      table['A' + i] = static_cast<uint8_t>(10 + i);
     }
+    return table;
+  }();
 
-    LOG_DEBUG("File opened successfully, parsing contents...");
-    std::string line;
-    uint32_t current_address = 0;
-    int lines_processed = 0;
-    int bytes_loaded = 0;
+  enum class ParseState { LineStart, Address, Data, SkipLine };
 
-    while (std::getline(file, line)) {
-      lines_processed++;
-      if (line.empty())
-        break;
+  Memory &memory;
+  std::vector<uint8_t> segment;
+  size_t segment_size = 0;
+  uint32_t segment_start = 0;
+  std::vector<ImageSegment> segments; // loaded address ranges
+  uint64_t source_hash = 0;
+  uint32_t entry_point = 0;
+  std::vector<ElfSymbol> symbols;
 
-      if (line[0] == '@') {
-        current_address = std::stoul(line.substr(1), nullptr, 16);
-        LOG_DEBUG("Setting address to: 0x" + std::to_string(current_address));
+  static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+  }
+
+  /**
+   * @brief Copies the bytes staged since the last flush into guest memory in
+   * one block and advances the segment start past them.
+   */
+  void flushSegment() {
+    if (segment_size > 0) {
+      memory.write_block(segment_start, segment.data(), segment_size);
+      if (!segments.empty() &&
+          segments.back().address + segments.back().size == segment_start) {
+        segments.back().size += static_cast<uint32_t>(segment_size);
       } else {
-        std::stringstream ss(line);
-        unsigned int byte_val;
-        while (ss >> std::hex >> byte_val) {
-          memory[current_address++] = static_cast<uint8_t>(byte_val);
-          bytes_loaded++;
-        }
+        segments.push_back({segment_start,
+                            static_cast<uint32_t>(segment_size), 0});
       }
+      segment_start += static_cast<uint32_t>(segment_size);
+      segment_size = 0;
     }
+  }
 
-    LOG_INFO("Binary file loaded successfully");
-    LOG_DEBUG("Processed " + std::to_string(lines_processed) +
-              " lines, loaded " + std::to_string(bytes_loaded) + " bytes");
-    LOG_DEBUG("Memory ranges from 0x0 to 0x" +
-              std::to_string(current_address - 1));
+  void emitByte(uint8_t value) {
+    segment[segment_size++] = value;
+    if (segment_size == SEGMENT_BUFFER_SIZE) {
+      flushSegment();
+    }
   }
 
-  void loadFromStdin() {
-    LOG_DEBUG("Reading binary data from stdin...");
-    std::string line;
-    uint32_t current_address = 0;
+  /**
+   * @brief Parses the `@address` / hex-byte image format from a stream.
+   *
+   * The input is consumed in large blocks and decoded with a lookup table
+   * into a fixed staging buffer, so no allocation happens per line or per
+   * byte. As with the line-based format, an empty line ends the image.
+   * @param next_block Callable that sets (data, length) to the next block of
+   * input and returns false once the input is exhausted.
+   * @return The number of bytes loaded.
+   */
+  template <typename BlockReader> size_t parse(BlockReader &&next_block) {
+    segment.resize(SEGMENT_BUFFER_SIZE);
+    segment_size = 0;
+    segment_start = 0;
+
+    ParseState state = ParseState::LineStart;
+    uint32_t value = 0;
+    bool in_token = false;
+    bool has_digits = false;
+    bool finished = false;
+    size_t bytes_loaded = 0;
     int lines_processed = 0;
-    int bytes_loaded = 0;
 
-    while (std::getline(std::cin, line)) {
-      lines_processed++;
-      if (line.empty())
-        break;
+    auto set_address = [&]() {
+      if (!has_digits) {
+        throw std::runtime_error("Malformed address marker in image");
+      }
+      flushSegment();
+      segment_start = value;
+      LOG_DEBUG("Setting address to: {}", norb::hex(value));
+    };
 
-      if (line[0] == '@') {
-        current_address = std::stoul(line.substr(1), nullptr, 16);
-        LOG_DEBUG("Setting address to: 0x" + std::to_string(current_address));
-      } else {
-        std::stringstream ss(line);
-        unsigned int byte_val;
-        while (ss >> std::hex >> byte_val) {
-          memory[current_address++] = static_cast<uint8_t>(byte_val);
-          bytes_loaded++;
+    const unsigned char *data = nullptr;
+    size_t length = 0;
+    while (!finished && next_block(data, length)) {
+      for (size_t i = 0; i < length && !finished; ++i) {
+        unsigned char c = data[i];
+        uint8_t digit = HEX_TABLE[c];
+
+        switch (state) {
+        case ParseState::LineStart:
+          if (c == '\n') {
+            finished = true; // an empty line terminates the image
+            break;
+          }
+          if (c == '@') {
+            state = ParseState::Address;
+            value = 0;
+            has_digits = false;
+            break;
+          }
+          state = ParseState::Data;
+          [[fallthrough]];
+        case ParseState::Data:
+          // Fast path for the common "XX " byte pattern.
+          if (!in_token) {
+            while (i + 2 < length && HEX_TABLE[data[i]] != NOT_HEX &&
+                   HEX_TABLE[data[i + 1]] != NOT_HEX && data[i + 2] == ' ') {
+              emitByte(static_cast<uint8_t>((HEX_TABLE[data[i]] << 4) |
+                                            HEX_TABLE[data[i + 1]]));
+              bytes_loaded++;
+              i += 3;
+            }
+            if (i >= length) {
+              break;
+            }
+            c = data[i];
+            digit = HEX_TABLE[c];
+          }
+          if (digit != NOT_HEX) {
+            value = in_token ? (value << 4) | digit : digit;
+            in_token = true;
+            break;
+          }
+          if (in_token) {
+            emitByte(static_cast<uint8_t>(value));
+            bytes_loaded++;
+            in_token = false;
+          }
+          if (c == '\n') {
+            lines_processed++;
+            state = ParseState::LineStart;
+          } else if (!isSpace(static_cast<char>(c))) {
+            state = ParseState::SkipLine;
+          }
+          break;
+        case ParseState::Address:
+          if (digit != NOT_HEX) {
+            value = (value << 4) | digit;
+            has_digits = true;
+            break;
+          }
+          set_address();
+          lines_processed += c == '\n';
+          state = c == '\n' ? ParseState::LineStart : ParseState::SkipLine;
+          break;
+        case ParseState::SkipLine:
+          if (c == '\n') {
+            lines_processed++;
+            state = ParseState::LineStart;
+          }
+          break;
         }
       }
     }
 
+    if (state == ParseState::Address) {
+      set_address();
+    } else if (in_token) {
+      emitByte(static_cast<uint8_t>(value));
+      bytes_loaded++;
+    }
+    flushSegment();
+
+    LOG_DEBUG("Processed {} lines, loaded {} bytes", lines_processed,
+              bytes_loaded);
+    return bytes_loaded;
+  }
+
+  /**
+   * @brief Parses hex text from a stream, reading it in large blocks.
+   */
+  size_t parseStream(std::istream &input) {
+    std::vector<char> block(READ_BLOCK_SIZE);
+    return parse([&](const unsigned char *&data, size_t &length) {
+      if (!input) {
+        return false;
+      }
+      input.read(block.data(), static_cast<std::streamsize>(block.size()));
+      data = reinterpret_cast<const unsigned char *>(block.data());
+      length = static_cast<size_t>(input.gcount());
+      return length > 0;
+    });
+  }
+
+  /**
+   * @brief Parses hex text that is already resident in memory.
+   */
+  size_t parseBuffer(const uint8_t *buffer, size_t size) {
+    bool consumed = false;
+    return parse([&](const unsigned char *&data, size_t &length) {
+      if (consumed || size == 0) {
+        return false;
+      }
+      consumed = true;
+      data = buffer;
+      length = size;
+      return true;
+    });
+  }
+
+  /**
+   * @brief Maps the segments of a validated binary image into guest memory.
+   * @throws std::runtime_error if the image is malformed.
+   */
+  void loadImage(const std::shared_ptr<MappedFile> &file) {
+    ImageHeader header;
+    segments = read_image_segments(file->data(), file->size(), header);
+    for (const auto &seg : segments) {
+      memory.map_block(seg.address, file->data() + seg.offset, seg.size, file);
+    }
+    source_hash = header.source_hash;
+    entry_point = header.entry_point;
+    LOG_DEBUG("Loaded {} segments from binary image", segments.size());
+  }
+
+  /**
+   * @brief Loads a cached image if it exists and matches source_hash.
+   * @return Whether the cache was used.
+   */
+  bool loadCachedImage(const std::string &cache_path) {
+    auto cache = std::make_shared<MappedFile>(cache_path);
+    if (!cache->is_open() || !is_binary_image(cache->data(), cache->size())) {
+      return false;
+    }
+    try {
+      ImageHeader header;
+      read_image_segments(cache->data(), cache->size(), header);
+      if (header.source_hash != source_hash) {
+        LOG_INFO("Image cache is stale: {}", cache_path);
+        return false;
+      }
+      loadImage(cache);
+    } catch (const std::runtime_error &e) {
+      LOG_WARN("Ignoring unreadable image cache: {}", e.what());
+      return false;
+    }
+    LOG_INFO("Loaded program from image cache: {}", cache_path);
+    return true;
+  }
+
+  void loadFile(const std::string &filename, bool use_image_cache) {
+    auto file = std::make_shared<MappedFile>(filename);
+    if (!file->is_open()) {
+      LOG_ERROR("Could not open file: {}", filename);
+      throw std::runtime_error("Could not open file: " + filename);
+    }
+
+    if (is_binary_image(file->data(), file->size())) {
+      loadImage(file);
+      LOG_INFO("Binary image loaded successfully");
+      return;
+    }
+
+    if (is_elf_file(file->data(), file->size())) {
+      ElfProgram program = load_elf(file, memory);
+      entry_point = program.entry_point;
+      segments = std::move(program.segments);
+      symbols = std::move(program.symbols);
+      source_hash = hash_bytes(file->data(), file->size());
+      LOG_INFO("ELF executable loaded successfully, entry point: {}",
+               norb::hex(entry_point));
+      return;
+    }
+
+    source_hash = hash_bytes(file->data(), file->size());
+    std::string cache_path = filename + IMAGE_CACHE_SUFFIX;
+    if (use_image_cache && loadCachedImage(cache_path)) {
+      return;
+    }
+
+    LOG_DEBUG("File opened successfully, parsing contents...");
+    parseBuffer(file->data(), file->size());
+    LOG_INFO("Binary file loaded successfully");
+
+    if (use_image_cache) {
+      try {
+        save_image(cache_path);
+      } catch (const std::runtime_error &e) {
+        LOG_WARN("Could not write image cache: {}", e.what());
+      }
+    }
+  }
+
+  void loadFromStdin() {
+    LOG_DEBUG("Reading binary data from stdin...");
+    parseStream(std::cin);
     LOG_INFO("Binary data loaded successfully from stdin");
-    LOG_DEBUG("Processed " + std::to_string(lines_processed) +
-              " lines, loaded " + std::to_string(bytes_loaded) + " bytes");
-    LOG_DEBUG("Memory ranges from 0x0 to 0x" +
-              std::to_string(current_address - 1));
   }
 };
 
@@ -0,0 +1,259 @@
+#ifndef UTILS_COMMIT_TRACE_HPP
+#define UTILS_COMMIT_TRACE_HPP
+
+#include "dump.hpp"
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Binary commit trace: the architectural state after every committed
+ * instruction, stored as the difference to the previous commit.
+ *
+ * Layout (all fields little-endian):
+ *   COMMIT_TRACE_MAGIC, then one record per committed instruction:
+ *     uint8_t  flags    bit 7: pc follows; otherwise pc is the previous + 4
+ *                       bits 0-5: number of changed registers
+ *     uint32_t pc       only if bit 7 is set
+ *     { uint8_t reg; uint32_t value; } for each changed register
+ *
+ * All registers are zero before the first record.
+ */
+constexpr std::array<char, 8> COMMIT_TRACE_MAGIC = {'R', 'V', 'S', 'I',
+                                                    'M', 'C', 'M', 'T'};
+constexpr uint8_t COMMIT_TRACE_PC = 0x80;
+constexpr uint8_t COMMIT_TRACE_COUNT_MASK = 0x3F;
+
+/**
+ * @brief Encodes commits into large buffers that a background thread writes
+ * to a file.
+ *
+ * The simulator fills one buffer while the writer thread writes the other;
+ * it only waits when it fills a buffer before the previous one is written.
+ */
+class CommitTraceWriter {
+  static constexpr size_t BUFFER_SIZE = 1 << 20;
+  static constexpr size_t MAX_RECORD = 1 + 4 + 5; // one register per commit
+
+  std::vector<uint8_t> active;  // being filled by the simulator
+  std::vector<uint8_t> pending; // handed to the writer thread
+  std::array<uint32_t, 32> registers{};
+  uint32_t next_pc = 0;
+  bool first = true;
+  uint64_t commits = 0;
+  uint64_t bytes = 0;
+
+  std::mutex mutex;
+  std::condition_variable ready;
+  bool pending_full = false;
+  bool stopping = false;
+  bool write_failed = false;
+  bool closed = false;
+  std::FILE *file;
+  std::thread writer;
+
+  void put32(uint32_t value) {
+    uint8_t le[4] = {static_cast<uint8_t>(value),
+                     static_cast<uint8_t>(value >> 8),
+                     static_cast<uint8_t>(value >> 16),
+                     static_cast<uint8_t>(value >> 24)};
+    active.insert(active.end(), le, le + 4);
+  }
+
+  void submit();
+  void drain();
+
+public:
+  /**
+   * @brief Creates the trace file and starts the writer thread.
+   * @throws std::runtime_error if the file cannot be created.
+   */
+  explicit CommitTraceWriter(const std::string &path);
+  ~CommitTraceWriter() { close(); }
+
+  CommitTraceWriter(const CommitTraceWriter &) = delete;
+  CommitTraceWriter &operator=(const CommitTraceWriter &) = delete;
+
+  /**
+   * @brief Records a committed instruction.
+   * @param rd The register it wrote, if any, and the value it now holds.
+   */
+  void record(uint32_t pc, std::optional<uint32_t> rd, uint32_t value) {
+    if (active.size() + MAX_RECORD > BUFFER_SIZE) {
+      submit();
+    }
+    bool changed = rd.has_value() && registers[*rd] != value;
+    uint8_t flags = changed ? 1 : 0;
+    if (first || pc != next_pc) {
+      flags |= COMMIT_TRACE_PC;
+    }
+    active.push_back(flags);
+    if (flags & COMMIT_TRACE_PC) {
+      put32(pc);
+    }
+    if (changed) {
+      registers[*rd] = value;
+      active.push_back(static_cast<uint8_t>(*rd));
+      put32(value);
+    }
+    first = false;
+    next_pc = pc + 4;
+    commits++;
+  }
+
+  /**
+   * @brief Writes out every recorded commit and closes the file.
+   * @return false if any write failed.
+   */
+  bool close();
+
+  void print_stats(std::ostream &os) const {
+    os << "Commit trace: " << commits << " commits, " << bytes + active.size()
+       << " bytes\n";
+  }
+};
+
+inline CommitTraceWriter::CommitTraceWriter(const std::string &path)
+    : file(std::fopen(path.c_str(), "wb")) {
+  if (!file) {
+    throw std::runtime_error("Could not open commit trace for writing: " +
+                             path);
+  }
+  if (std::fwrite(COMMIT_TRACE_MAGIC.data(), 1, COMMIT_TRACE_MAGIC.size(),
+                  file) != COMMIT_TRACE_MAGIC.size()) {
+    std::fclose(file);
+    throw std::runtime_error("Failed to write commit trace: " + path);
+  }
+  active.reserve(BUFFER_SIZE);
+  pending.reserve(BUFFER_SIZE);
+  writer = std::thread(&CommitTraceWriter::drain, this);
+}
+
+/**
+ * @brief Hands the filled buffer to the writer thread, waiting for it to
+ * finish the previous one first.
+ */
+inline void CommitTraceWriter::submit() {
+  std::unique_lock<std::mutex> lock(mutex);
+  ready.wait(lock, [this] { return !pending_full; });
+  bytes += active.size();
+  std::swap(active, pending);
+  pending_full = true;
+  lock.unlock();
+  ready.notify_all();
+  active.clear();
+}
+
+inline void CommitTraceWriter::drain() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    ready.wait(lock, [this] { return pending_full || stopping; });
+    if (!pending_full) {
+      return;
+    }
+    // The simulator does not touch pending until pending_full is cleared.
+    lock.unlock();
+    bool ok = std::fwrite(pending.data(), 1, pending.size(), file) ==
+              pending.size();
+    lock.lock();
+    write_failed |= !ok;
+    pending_full = false;
+    ready.notify_all();
+  }
+}
+
+inline bool CommitTraceWriter::close() {
+  if (closed) {
+    return !write_failed;
+  }
+  closed = true;
+  if (!active.empty()) {
+    submit();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  ready.notify_all();
+  writer.join();
+  if (std::fclose(file) != 0) {
+    write_failed = true;
+  }
+  return !write_failed;
+}
+
+/**
+ * @brief Expands a commit trace into a register dump with one line per
+ * commit, in the format of norb::dump_line().
+ * @throws std::runtime_error if the file is missing, not a commit trace, or
+ * truncated.
+ */
+inline void decode_commit_trace(const std::string &path, std::ostream &os) {
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    throw std::runtime_error("Could not open commit trace: " + path);
+  }
+  std::vector<uint8_t> buffer;
+  size_t at = 0;
+  // Makes at least need unread bytes available, unless the file ends first.
+  auto fill = [&](size_t need) {
+    if (buffer.size() - at < need) {
+      buffer.erase(buffer.begin(), buffer.begin() + at);
+      at = 0;
+      size_t have = buffer.size();
+      buffer.resize(have + (1 << 16));
+      have += std::fread(buffer.data() + have, 1, buffer.size() - have, file);
+      buffer.resize(have);
+    }
+    return buffer.size() - at >= need;
+  };
+  auto get32 = [&]() {
+    uint32_t value = static_cast<uint32_t>(buffer[at]) |
+                     static_cast<uint32_t>(buffer[at + 1]) << 8 |
+                     static_cast<uint32_t>(buffer[at + 2]) << 16 |
+                     static_cast<uint32_t>(buffer[at + 3]) << 24;
+    at += 4;
+    return value;
+  };
+
+  if (!fill(COMMIT_TRACE_MAGIC.size()) ||
+      std::memcmp(buffer.data(), COMMIT_TRACE_MAGIC.data(),
+                  COMMIT_TRACE_MAGIC.size()) != 0) {
+    std::fclose(file);
+    throw std::runtime_error("Not a commit trace: " + path);
+  }
+  at = COMMIT_TRACE_MAGIC.size();
+
+  std::array<uint32_t, 32> registers{};
+  uint32_t pc = 0;
+  int line = 0;
+  while (fill(1)) {
+    uint8_t flags = buffer[at++];
+    uint32_t changes = flags & COMMIT_TRACE_COUNT_MASK;
+    if (!fill((flags & COMMIT_TRACE_PC ? 4 : 0) + changes * 5)) {
+      std::fclose(file);
+      throw std::runtime_error("Truncated commit trace: " + path);
+    }
+    if (flags & COMMIT_TRACE_PC) {
+      pc = get32();
+    }
+    for (uint32_t i = 0; i < changes; i++) {
+      uint8_t reg = buffer[at++] & 31;
+      registers[reg] = get32();
+    }
+    os << norb::dump_line(++line, pc, registers);
+    pc += 4;
+  }
+  std::fclose(file);
+}
+
+#endif // UTILS_COMMIT_TRACE_HPP
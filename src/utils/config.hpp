@@ -0,0 +1,52 @@
+#ifndef UTILS_CONFIG_HPP
+#define UTILS_CONFIG_HPP
+
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+/**
+ * @brief Parses the value of a numeric configuration key. Sizes accept a K or
+ * M suffix.
+ * @throws std::invalid_argument if value is not a number.
+ */
+inline uint32_t parse_config_number(const std::string &key,
+                                    const std::string &value) {
+  size_t end = 0;
+  unsigned long number;
+  try {
+    number = std::stoul(value, &end);
+  } catch (const std::exception &) {
+    throw std::invalid_argument("invalid value for " + key + ": " + value);
+  }
+  std::string suffix = value.substr(end);
+  if (suffix == "K" || suffix == "k") {
+    number *= 1024;
+  } else if (suffix == "M" || suffix == "m") {
+    number *= 1024 * 1024;
+  } else if (!suffix.empty()) {
+    throw std::invalid_argument("invalid value for " + key + ": " + value);
+  }
+  return static_cast<uint32_t>(number);
+}
+
+/**
+ * @brief Splits a comma-separated key=value list and calls
+ * handle(key, value) for each item in order.
+ * @throws std::invalid_argument if an item has no '='.
+ */
+template <typename Handler>
+inline void parse_config_options(const std::string &spec, Handler handle) {
+  std::stringstream stream(spec);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    size_t equals = item.find('=');
+    if (equals == std::string::npos) {
+      throw std::invalid_argument("expected key=value, got: " + item);
+    }
+    handle(item.substr(0, equals), item.substr(equals + 1));
+  }
+}
+
+#endif // UTILS_CONFIG_HPP
@@ -4,7 +4,6 @@
 #include <array>
 #include <bitset>
 #include <cstdint>
-#include <fstream>
 #include <iomanip>
 #include <sstream>
 #include <string>
@@ -30,55 +29,30 @@ inline std::string pad_with_zero(uint32_t x, int width = 4) {
   return oss.str();
 }
 
+/**
+ * @brief Formats the register file after a commit as one line of a register
+ * dump, the format the golden model's dumps are compared in.
+ * @param line_number 1-based index of the commit.
+ */
 template <size_t reg_count_, typename RegType_ = uint32_t>
-class RegisterDumper {
-private:
-  std::ofstream file_;
-  int line_number_;
-
-public:
-  RegisterDumper(const std::string &filename) : line_number_(0) {
-    // Clear the file at bootup and keep it open
-    file_.open(filename, std::ios::trunc);
-    if (!file_.is_open()) {
-      throw std::runtime_error("Failed to open file for register dumping: " +
-                               filename);
-    }
-  }
-
-  ~RegisterDumper() {
-    if (file_.is_open()) {
-      file_.close();
-    }
-  }
-
-  void dump(uint32_t pc_at_commit,
-            const std::array<RegType_, reg_count_> &reg_snapshot) {
-    dump_impl(pc_at_commit, reg_snapshot);
+std::string dump_line(int line_number, uint32_t pc_at_commit,
+                      const std::array<RegType_, reg_count_> &reg_snapshot) {
+  std::ostringstream oss;
+  oss << "[" << norb::pad_with_zero(line_number, 4)
+      << "] ";                             // line number for each line
+  oss << norb::hex(pc_at_commit) << " | "; // PC at commit
+  for (size_t i = 0; i < reg_count_; ++i) {
+    const auto reg_value = reg_snapshot[i];
+    if (reg_value == 0)
+      oss << "R" << i << "(" << 0 << ")";
+    else
+      oss << "R" << i << "(" << reg_value << "=" << norb::hex(reg_value)
+          << ")";
+    if (i < reg_count_ - 1)
+      oss << " ";
   }
+  oss << "\n";
+  return oss.str();
+}
 
-private:
-  void dump_impl(uint32_t pc_at_commit,
-                 const std::array<RegType_, reg_count_> &reg_snapshot) {
-    std::ostringstream oss;
-    oss << "[" << norb::pad_with_zero(++line_number_, 4)
-        << "] ";                             // line number for each line
-    oss << norb::hex(pc_at_commit) << " | "; // PC at commit
-    for (size_t i = 0; i < reg_count_; ++i) {
-      const auto reg_value = reg_snapshot[i];
-      if (reg_value == 0)
-        oss << "R" << i << "(" << 0 << ")";
-      else
-        oss << "R" << i << "(" << reg_value << "=" << norb::hex(reg_value)
-            << ")";
-      if (i < reg_count_ - 1)
-        oss << " ";
-    }
-    oss << "\n";
-
-    // Write to the persistent file stream
-    file_ << oss.str();
-    file_.flush(); // Ensure data is written immediately
-  }
-};
 } // namespace norb
@@ -0,0 +1,174 @@
+#ifndef UTILS_ELF_LOADER_HPP
+#define UTILS_ELF_LOADER_HPP
+
+#include "../core/memory.hpp"
+#include "binary_image.hpp"
+#include "dump.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <elf.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#undef LOG_MODULE
+#define LOG_MODULE Logger::Module::LOADER
+
+struct ElfSymbol {
+  uint32_t address;
+  uint32_t size;
+  std::string name;
+};
+
+struct ElfProgram {
+  uint32_t entry_point;
+  std::vector<ImageSegment> segments; // PT_LOAD address ranges (memsz)
+  std::vector<ElfSymbol> symbols;     // sorted by address
+};
+
+/**
+ * @brief Checks whether a buffer starts with the ELF magic.
+ */
+inline bool is_elf_file(const uint8_t *data, size_t size) {
+  return size >= SELFMAG && std::memcmp(data, ELFMAG, SELFMAG) == 0;
+}
+
+/**
+ * @brief Copies a trivially copyable struct out of the file, bounds-checked.
+ */
+template <typename T>
+inline T read_elf_struct(const uint8_t *data, size_t size, uint64_t offset) {
+  if (offset > size || sizeof(T) > size - offset) {
+    throw std::runtime_error("Truncated ELF file");
+  }
+  T value;
+  std::memcpy(&value, data + offset, sizeof(T));
+  return value;
+}
+
+/**
+ * @brief Collects function and object symbols from the first SHT_SYMTAB.
+ */
+inline std::vector<ElfSymbol> read_elf_symbols(const uint8_t *data,
+                                               size_t size,
+                                               const Elf32_Ehdr &ehdr) {
+  std::vector<ElfSymbol> symbols;
+  for (uint32_t i = 0; i < ehdr.e_shnum; ++i) {
+    auto shdr = read_elf_struct<Elf32_Shdr>(
+        data, size, ehdr.e_shoff + uint64_t(i) * ehdr.e_shentsize);
+    if (shdr.sh_type != SHT_SYMTAB || shdr.sh_link >= ehdr.e_shnum) {
+      continue;
+    }
+    auto strtab = read_elf_struct<Elf32_Shdr>(
+        data, size, ehdr.e_shoff + uint64_t(shdr.sh_link) * ehdr.e_shentsize);
+    if (strtab.sh_offset > size || strtab.sh_size > size - strtab.sh_offset) {
+      throw std::runtime_error("Truncated ELF string table");
+    }
+    const char *names = reinterpret_cast<const char *>(data + strtab.sh_offset);
+
+    uint32_t count = shdr.sh_entsize ? shdr.sh_size / shdr.sh_entsize : 0;
+    for (uint32_t j = 0; j < count; ++j) {
+      auto sym = read_elf_struct<Elf32_Sym>(
+          data, size, shdr.sh_offset + uint64_t(j) * shdr.sh_entsize);
+      int type = ELF32_ST_TYPE(sym.st_info);
+      if ((type != STT_FUNC && type != STT_OBJECT) ||
+          sym.st_name >= strtab.sh_size) {
+        continue;
+      }
+      const char *name = names + sym.st_name;
+      size_t length = strnlen(name, strtab.sh_size - sym.st_name);
+      symbols.push_back({sym.st_value, sym.st_size, std::string(name, length)});
+    }
+    break;
+  }
+  std::sort(symbols.begin(), symbols.end(),
+            [](const ElfSymbol &a, const ElfSymbol &b) {
+              return a.address < b.address;
+            });
+  return symbols;
+}
+
+/**
+ * @brief Loads a statically linked RV32 ELF executable into guest memory.
+ *
+ * PT_LOAD segments are mapped straight from the (private) file mapping where
+ * they cover whole guest pages; the rest of p_filesz is copied and the tail up
+ * to p_memsz (.bss) is zero-filled.
+ * @param file The mapped ELF file; kept alive by memory while mapped.
+ * @param memory The guest memory to load into.
+ * @return The entry point, loaded ranges and symbol table.
+ * @throws std::runtime_error if the file is not a valid RV32 executable.
+ */
+inline ElfProgram load_elf(const std::shared_ptr<MappedFile> &file,
+                           Memory &memory) {
+  const uint8_t *data = file->data();
+  size_t size = file->size();
+  if (!is_elf_file(data, size)) {
+    throw std::runtime_error("Not an ELF file");
+  }
+  auto ehdr = read_elf_struct<Elf32_Ehdr>(data, size, 0);
+  if (ehdr.e_ident[EI_CLASS] != ELFCLASS32 ||
+      ehdr.e_ident[EI_DATA] != ELFDATA2LSB) {
+    throw std::runtime_error("Only little-endian ELF32 files are supported");
+  }
+  if (ehdr.e_machine != EM_RISCV) {
+    throw std::runtime_error("ELF file is not a RISC-V executable");
+  }
+  if (ehdr.e_type != ET_EXEC) {
+    throw std::runtime_error("Only statically linked ELF executables are "
+                             "supported");
+  }
+
+  ElfProgram program;
+  program.entry_point = ehdr.e_entry;
+
+  for (uint32_t i = 0; i < ehdr.e_phnum; ++i) {
+    auto phdr = read_elf_struct<Elf32_Phdr>(
+        data, size, ehdr.e_phoff + uint64_t(i) * ehdr.e_phentsize);
+    if (phdr.p_type != PT_LOAD || phdr.p_memsz == 0) {
+      continue;
+    }
+    if (phdr.p_filesz > phdr.p_memsz || phdr.p_offset > size ||
+        phdr.p_filesz > size - phdr.p_offset) {
+      throw std::runtime_error("Malformed ELF program header");
+    }
+
+    memory.map_block(phdr.p_vaddr, file->data() + phdr.p_offset,
+                     phdr.p_filesz, file);
+    memory.zero_block(phdr.p_vaddr + phdr.p_filesz,
+                      phdr.p_memsz - phdr.p_filesz);
+    program.segments.push_back({phdr.p_vaddr, phdr.p_memsz, 0});
+    LOG_DEBUG("Loaded ELF segment at {}, filesz={}, memsz={}",
+              norb::hex(phdr.p_vaddr), phdr.p_filesz, phdr.p_memsz);
+  }
+
+  if (ehdr.e_shoff != 0) {
+    program.symbols = read_elf_symbols(data, size, ehdr);
+  }
+  return program;
+}
+
+/**
+ * @brief Finds the symbol containing address, or the closest preceding
+ * symbol when sizes are unknown.
+ * @return The symbol, or nullptr if none precedes address.
+ */
+inline const ElfSymbol *find_elf_symbol(const std::vector<ElfSymbol> &symbols,
+                                        uint32_t address) {
+  auto it = std::upper_bound(
+      symbols.begin(), symbols.end(), address,
+      [](uint32_t addr, const ElfSymbol &sym) { return addr < sym.address; });
+  if (it == symbols.begin()) {
+    return nullptr;
+  }
+  --it;
+  if (it->size != 0 && address - it->address >= it->size) {
+    return nullptr;
+  }
+  return &*it;
+}
+
+#endif // UTILS_ELF_LOADER_HPP
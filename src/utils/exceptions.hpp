@@ -1,6 +1,7 @@
 #ifndef UTILS_EXCEPTIONS_HPP
 #define UTILS_EXCEPTIONS_HPP
 
+#include <stdexcept>
 #include <string>
 
 /**
@@ -22,4 +23,14 @@ public:
   int get_exit_code() const { return exit_code; }
 };
 
+/**
+ * @brief Exception thrown when a committed instruction differs from the
+ * golden model during co-simulation. what() is the full report.
+ */
+class CoSimulationMismatch : public std::runtime_error {
+public:
+  explicit CoSimulationMismatch(const std::string &report)
+      : std::runtime_error(report) {}
+};
+
 #endif // UTILS_EXCEPTIONS_HPP
\ No newline at end of file
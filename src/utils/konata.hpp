@@ -0,0 +1,166 @@
+#ifndef UTILS_KONATA_HPP
+#define UTILS_KONATA_HPP
+
+#include "trace.hpp"
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+/**
+ * @brief Converts a pipeline trace into the Kanata log format read by the
+ * Konata pipeline viewer, which also opens gem5 O3PipeView logs.
+ *
+ * Every fetched instruction becomes one row. Its stages are:
+ *   F    fetched, waiting in the fetch buffer
+ *   Is   issued into the ROB, waiting in a reservation station or the LSB
+ *   Ex   executing in the ALU            Br   executing in the branch unit
+ *   Mem  load accessing memory           Wb   result broadcast, awaiting commit
+ * A row ends when its instruction commits, or is flushed: by a
+ * misprediction or replay, or by a Redirect event discarding it from the
+ * fetch buffer before issue.
+ */
+class KonataWriter {
+  struct Instruction {
+    uint64_t id;
+    uint32_t pc;
+    const char *stage;
+  };
+
+  std::ostream &os;
+  uint64_t cycle = 0;
+  bool started = false;
+  uint64_t next_id = 0;
+  uint64_t next_retire_id = 0;
+  std::deque<Instruction> fetched;          // fetch buffer, oldest first
+  std::map<uint32_t, Instruction> in_flight; // by ROB ID
+
+  void advance_to(uint64_t target) {
+    if (!started) {
+      os << "C=\t" << target << '\n';
+      started = true;
+    } else if (target > cycle) {
+      os << "C\t" << target - cycle << '\n';
+    }
+    cycle = target;
+  }
+
+  Instruction start(uint32_t pc) {
+    Instruction instruction{next_id++, pc, nullptr};
+    std::ostringstream label;
+    label << "0x" << std::hex << std::setw(8) << std::setfill('0') << pc;
+    os << "I\t" << instruction.id << '\t' << instruction.id << "\t0\n"
+       << "L\t" << instruction.id << "\t0\t" << label.str() << '\n';
+    return instruction;
+  }
+
+  void enter(Instruction &instruction, const char *stage) {
+    if (instruction.stage) {
+      os << "E\t" << instruction.id << "\t0\t" << instruction.stage << '\n';
+    }
+    os << "S\t" << instruction.id << "\t0\t" << stage << '\n';
+    instruction.stage = stage;
+  }
+
+  void retire(Instruction &instruction, bool flushed) {
+    if (instruction.stage) {
+      os << "E\t" << instruction.id << "\t0\t" << instruction.stage << '\n';
+    }
+    os << "R\t" << instruction.id << '\t'
+       << (flushed ? 0 : next_retire_id++) << '\t' << (flushed ? 1 : 0)
+       << '\n';
+  }
+
+  void issue(const TraceRecord &r) {
+    Instruction instruction;
+    if (fetched.empty()) {
+      instruction = start(r.pc); // fetched before the trace started
+    } else {
+      instruction = fetched.front();
+      fetched.pop_front();
+    }
+    os << "L\t" << instruction.id << "\t1\trob " << r.rob_id << '\n';
+    enter(instruction, "Is");
+    in_flight[r.rob_id] = instruction;
+  }
+
+  void flush() {
+    for (auto &[rob_id, instruction] : in_flight) {
+      retire(instruction, true);
+    }
+    in_flight.clear();
+    for (Instruction &instruction : fetched) {
+      retire(instruction, true);
+    }
+    fetched.clear();
+  }
+
+  // Squashes the youngest count fetched rows.
+  void redirect(uint32_t count) {
+    for (; count > 0 && !fetched.empty(); count--) {
+      retire(fetched.back(), true);
+      fetched.pop_back();
+    }
+  }
+
+public:
+  explicit KonataWriter(std::ostream &os) : os(os) { os << "Kanata\t0004\n"; }
+
+  void record(const TraceRecord &r) {
+    advance_to(r.cycle);
+    if (r.event == TraceEvent::Fetch) {
+      fetched.push_back(start(r.pc));
+      enter(fetched.back(), "F");
+      return;
+    }
+    if (r.event == TraceEvent::Issue) {
+      issue(r);
+      return;
+    }
+    if (r.event == TraceEvent::Flush) {
+      flush();
+      return;
+    }
+    if (r.event == TraceEvent::Redirect) {
+      redirect(r.value);
+      return;
+    }
+
+    auto it = in_flight.find(r.rob_id);
+    if (it == in_flight.end()) {
+      return; // store buffer drains, or issued before the trace started
+    }
+    Instruction &instruction = it->second;
+    switch (r.event) {
+    case TraceEvent::Dispatch:
+      enter(instruction, r.unit == TraceUnit::Branch ? "Br" : "Ex");
+      break;
+    case TraceEvent::MemStart:
+      enter(instruction, "Mem");
+      break;
+    case TraceEvent::Broadcast:
+      enter(instruction, "Wb");
+      break;
+    case TraceEvent::Commit:
+      retire(instruction, false);
+      in_flight.erase(it);
+      break;
+    default:
+      break;
+    }
+  }
+};
+
+/**
+ * @brief Writes the Kanata log of a trace file to os.
+ * @throws std::runtime_error as read_trace().
+ */
+inline void write_konata(const std::string &trace_path, std::ostream &os) {
+  KonataWriter writer(os);
+  read_trace(trace_path, [&](const TraceRecord &r) { writer.record(r); });
+}
+
+#endif // UTILS_KONATA_HPP
@@ -1,15 +1,51 @@
 #ifndef LOGGER_HPP
 #define LOGGER_HPP
 
-#include <chrono>
-#include <iomanip>
-#include <iostream>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 
 namespace Logger {
 
 enum class Level { NONE = 0, ERROR = 1, WARN = 2, INFO = 3, DEBUG = 4 };
 
+/**
+ * Subsystems messages can be filtered by. Each header that logs selects its
+ * module by redefining LOG_MODULE after its includes.
+ */
+enum class Module {
+  MAIN,
+  CPU,
+  ROB,
+  RS,
+  LSB,
+  PRED,
+  CACHE,
+  DRAM,
+  REGFILE,
+  DECODE,
+  LOADER,
+  COUNT
+};
+
+inline constexpr const char *MODULE_NAMES[] = {
+    "main",  "cpu",     "rob",    "rs",    "lsb", "pred",
+    "cache", "dram", "regfile", "decode", "loader"};
+
+static_assert(sizeof(MODULE_NAMES) / sizeof(MODULE_NAMES[0]) ==
+                  static_cast<size_t>(Module::COUNT),
+              "every module needs a name");
+
+/**
+ * Highest level compiled into the binary. Every level is compiled in by
+ * default and selected at runtime; defining LOGGING_LEVEL_<LEVEL> before the
+ * first include strips the levels above it, arguments included.
+ */
 constexpr Level getCurrentLevel() {
 #ifdef LOGGING_LEVEL_NONE
   return Level::NONE;
@@ -19,13 +55,117 @@ constexpr Level getCurrentLevel() {
   return Level::WARN;
 #elif defined(LOGGING_LEVEL_INFO)
   return Level::INFO;
-#elif defined(LOGGING_LEVEL_DEBUG)
-  return Level::DEBUG;
 #else
-  return Level::INFO;
+  return Level::DEBUG;
 #endif
 }
 
+constexpr Level COMPILED_LEVEL = getCurrentLevel();
+
+constexpr bool isCompiledIn(Level level) {
+  return level != Level::NONE &&
+         static_cast<int>(level) <= static_cast<int>(COMPILED_LEVEL);
+}
+
+constexpr uint32_t ALL_MODULES = (1U << static_cast<int>(Module::COUNT)) - 1;
+constexpr int MODULE_BITS = 16;
+
+static_assert(static_cast<int>(Module::COUNT) <= MODULE_BITS,
+              "module mask does not fit the filter");
+
+inline Level runtimeLevel = Level::NONE;
+inline uint32_t moduleMask = ALL_MODULES;
+
+// Runtime filter checked at every log site before the message is built: one
+// bit per level and module, so the check is a single load and bit test.
+inline std::atomic<uint64_t> filter{0};
+
+inline void updateFilter() {
+  uint64_t bits = 0;
+  for (int level = 1; level <= static_cast<int>(runtimeLevel); level++) {
+    bits |= static_cast<uint64_t>(moduleMask) << ((level - 1) * MODULE_BITS);
+  }
+  filter.store(bits, std::memory_order_relaxed);
+}
+
+// Simulated cycle, reported by the CPU and printed with every message.
+inline uint64_t currentCycle = 0;
+// A level switched on once currentCycle reaches startCycle.
+inline Level pendingLevel = Level::NONE;
+inline uint64_t startCycle = UINT64_MAX;
+
+inline void setLevel(Level level) {
+  runtimeLevel = level;
+  updateFilter();
+}
+
+inline void setModules(uint32_t mask) {
+  moduleMask = mask;
+  updateFilter();
+}
+
+/**
+ * @brief Keeps logging at its current level until the given cycle, then
+ * switches to level.
+ */
+inline void setLevelFrom(Level level, uint64_t cycle) {
+  pendingLevel = level;
+  startCycle = cycle;
+}
+
+inline void setCycle(uint64_t cycle) {
+  currentCycle = cycle;
+  if (cycle == startCycle) {
+    setLevel(pendingLevel);
+  }
+}
+
+inline bool isEnabled(Level level, Module module) {
+  int bit =
+      (static_cast<int>(level) - 1) * MODULE_BITS + static_cast<int>(module);
+  return (filter.load(std::memory_order_relaxed) >> bit) & 1;
+}
+
+/**
+ * @brief Parses none, error, warn, info or debug.
+ * @throws std::invalid_argument on any other name.
+ */
+inline Level parseLevel(const std::string &name) {
+  static constexpr const char *NAMES[] = {"none", "error", "warn", "info",
+                                          "debug"};
+  for (int i = 0; i <= static_cast<int>(Level::DEBUG); i++) {
+    if (name == NAMES[i]) {
+      return static_cast<Level>(i);
+    }
+  }
+  throw std::invalid_argument("unknown log level: " + name);
+}
+
+/**
+ * @brief Parses a comma-separated module list such as "rob,lsb" into a mask.
+ * @throws std::invalid_argument on unknown module names.
+ */
+inline uint32_t parseModules(const std::string &list) {
+  if (list == "all") {
+    return ALL_MODULES;
+  }
+  uint32_t mask = 0;
+  std::stringstream ss(list);
+  std::string name;
+  while (std::getline(ss, name, ',')) {
+    int module = 0;
+    while (module < static_cast<int>(Module::COUNT) &&
+           name != MODULE_NAMES[module]) {
+      module++;
+    }
+    if (module == static_cast<int>(Module::COUNT)) {
+      throw std::invalid_argument("unknown log module: " + name);
+    }
+    mask |= 1U << module;
+  }
+  return mask;
+}
+
 inline const char *getLevelString(Level level) {
   switch (level) {
   case Level::ERROR:
@@ -41,73 +181,102 @@ inline const char *getLevelString(Level level) {
   }
 }
 
-inline std::string getTimestamp() {
-  auto now = std::chrono::system_clock::now();
-  auto time_t = std::chrono::system_clock::to_time_t(now);
-  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now.time_since_epoch()) %
-            1000;
-
-  std::stringstream ss;
-  ss << std::put_time(std::localtime(&time_t), "%H:%M:%S");
-  ss << '.' << std::setfill('0') << std::setw(3) << ms.count();
-  return ss.str();
+inline void formatTo(std::ostringstream &os, std::string_view fmt) {
+  os << fmt;
 }
 
-inline void log(Level level, const std::string &message) {
-  // if (static_cast<int>(level) <= static_cast<int>(getCurrentLevel())) {
-  //     std::cerr << "[" << getTimestamp() << "] "
-  //               << "[" << getLevelString(level) << "] "
-  //               << message << std::endl;
-  // }
+template <typename T, typename... Args>
+void formatTo(std::ostringstream &os, std::string_view fmt, const T &arg,
+              const Args &...args) {
+  size_t pos = fmt.find("{}");
+  if (pos == std::string_view::npos) {
+    os << fmt;
+    return;
+  }
+  os << fmt.substr(0, pos) << arg;
+  formatTo(os, fmt.substr(pos + 2), args...);
 }
 
-inline void error(const std::string &message) { log(Level::ERROR, message); }
-
-inline void warn(const std::string &message) { log(Level::WARN, message); }
-
-inline void info(const std::string &message) { log(Level::INFO, message); }
-
-inline void debug(const std::string &message) { log(Level::DEBUG, message); }
-
-// Template specialization for string literals
-template <size_t N> inline void error(const char (&message)[N]) {
-  log(Level::ERROR, std::string(message));
+/**
+ * @brief Replaces each "{}" in fmt with the next argument, std::format style.
+ * A message without arguments is returned unchanged.
+ */
+template <typename... Args>
+[[gnu::cold, gnu::noinline]] std::string format(std::string_view fmt,
+                                                const Args &...args) {
+  if constexpr (sizeof...(args) == 0) {
+    return std::string(fmt);
+  } else {
+    std::ostringstream os;
+    formatTo(os, fmt, args...);
+    return os.str();
+  }
 }
 
-template <size_t N> inline void warn(const char (&message)[N]) {
-  log(Level::WARN, std::string(message));
-}
+/**
+ * @brief Buffers formatted lines and writes them to stderr in large chunks.
+ *
+ * The buffer is flushed when it fills, after every error and at exit.
+ */
+class Sink {
+  static constexpr size_t FLUSH_SIZE = 64 * 1024;
 
-template <size_t N> inline void info(const char (&message)[N]) {
-  log(Level::INFO, std::string(message));
-}
+  std::mutex mutex;
+  std::string buffer;
 
-template <size_t N> inline void debug(const char (&message)[N]) {
-  log(Level::DEBUG, std::string(message));
-}
+  void flush_locked() {
+    std::fwrite(buffer.data(), 1, buffer.size(), stderr);
+    std::fflush(stderr);
+    buffer.clear();
+  }
 
-template <typename T> inline void error(const T &message) {
-  log(Level::ERROR, std::to_string(message));
-}
+public:
+  Sink() { buffer.reserve(FLUSH_SIZE + 256); }
+  ~Sink() { flush(); }
 
-template <typename T> inline void warn(const T &message) {
-  log(Level::WARN, std::to_string(message));
-}
+  [[gnu::cold, gnu::noinline]] void write(Level level, Module module,
+                                          const std::string &message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    buffer += "[" + std::to_string(currentCycle) + "] [";
+    buffer += getLevelString(level);
+    buffer += "] [";
+    buffer += MODULE_NAMES[static_cast<int>(module)];
+    buffer += "] ";
+    buffer += message;
+    buffer += '\n';
+    if (buffer.size() >= FLUSH_SIZE || level == Level::ERROR) {
+      flush_locked();
+    }
+  }
 
-template <typename T> inline void info(const T &message) {
-  log(Level::INFO, std::to_string(message));
-}
+  void flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    flush_locked();
+  }
+};
 
-template <typename T> inline void debug(const T &message) {
-  log(Level::DEBUG, std::to_string(message));
-}
+inline Sink sink;
 
 } // namespace Logger
 
-#define LOG_ERROR(msg) Logger::error(msg)
-#define LOG_WARN(msg) Logger::warn(msg)
-#define LOG_INFO(msg) Logger::info(msg)
-#define LOG_DEBUG(msg) Logger::debug(msg)
+#ifndef LOG_MODULE
+#define LOG_MODULE Logger::Module::MAIN
+#endif
+
+// The message and its arguments are only evaluated when the level is compiled
+// in and the level and module pass the runtime filter.
+#define LOGGER_LOG_AT(level, ...)                                              \
+  do {                                                                         \
+    if constexpr (Logger::isCompiledIn(level)) {                               \
+      if (Logger::isEnabled(level, LOG_MODULE)) [[unlikely]] {                 \
+        Logger::sink.write(level, LOG_MODULE, Logger::format(__VA_ARGS__));    \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+#define LOG_ERROR(...) LOGGER_LOG_AT(Logger::Level::ERROR, __VA_ARGS__)
+#define LOG_WARN(...) LOGGER_LOG_AT(Logger::Level::WARN, __VA_ARGS__)
+#define LOG_INFO(...) LOGGER_LOG_AT(Logger::Level::INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOGGER_LOG_AT(Logger::Level::DEBUG, __VA_ARGS__)
 
 #endif // LOGGER_HPP
@@ -1,7 +1,11 @@
 #ifndef UTILS_QUEUE_HPP
 #define UTILS_QUEUE_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <stdexcept>
+#include <vector>
 
 template <typename T> class CircularQueue {
 private:
@@ -25,6 +29,11 @@ public:
     return arr[offset];
   }
 
+  const T &get(int index) const {
+    int offset = (frontIdx + index) % capacity;
+    return arr[offset];
+  }
+
   bool remove(int index) {
     if (index < 0 || index >= count)
       return false;
@@ -97,4 +106,75 @@ public:
   int size() const { return count; }
 };
 
+/**
+ * @brief Bounded lock-free queue between exactly one producer thread and one
+ * consumer thread.
+ *
+ * The producer only advances head and the consumer only advances tail; each
+ * side keeps a cached copy of the other's index so the shared cache lines are
+ * only read when the queue looks full or empty.
+ */
+template <typename T> class SPSCQueue {
+  std::vector<T> slots;
+  uint64_t mask;
+  alignas(64) std::atomic<uint64_t> head{0}; // next slot to fill
+  alignas(64) std::atomic<uint64_t> tail{0}; // next slot to read
+  alignas(64) uint64_t cached_tail = 0;      // producer's copy of tail
+  alignas(64) uint64_t cached_head = 0;      // consumer's copy of head
+
+public:
+  // capacity must be a power of two
+  explicit SPSCQueue(size_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+  // Producer only. Returns false if the queue is full.
+  bool try_push(const T &value) {
+    uint64_t slot = head.load(std::memory_order_relaxed);
+    if (slot - cached_tail == slots.size()) {
+      cached_tail = tail.load(std::memory_order_acquire);
+      if (slot - cached_tail == slots.size()) {
+        return false;
+      }
+    }
+    slots[slot & mask] = value;
+    head.store(slot + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Returns false if the queue is empty.
+  bool try_pop(T &value) {
+    uint64_t slot = tail.load(std::memory_order_relaxed);
+    if (slot == cached_head) {
+      cached_head = head.load(std::memory_order_acquire);
+      if (slot == cached_head) {
+        return false;
+      }
+    }
+    value = slots[slot & mask];
+    tail.store(slot + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Consumer only. Calls consume(const T *first, size_t count) with
+   * the longest run of queued elements that is contiguous in the ring, then
+   * frees those slots.
+   * @return The number of elements consumed; 0 if the queue is empty.
+   */
+  template <typename Consumer> size_t pop_run(Consumer consume) {
+    uint64_t slot = tail.load(std::memory_order_relaxed);
+    if (slot == cached_head) {
+      cached_head = head.load(std::memory_order_acquire);
+      if (slot == cached_head) {
+        return 0;
+      }
+    }
+    uint64_t begin = slot & mask;
+    size_t count = static_cast<size_t>(
+        std::min<uint64_t>(cached_head - slot, slots.size() - begin));
+    consume(&slots[begin], count);
+    tail.store(slot + count, std::memory_order_release);
+    return count;
+  }
+};
+
 #endif // UTILS_QUEUE_HPP
@@ -0,0 +1,271 @@
+#ifndef UTILS_TRACE_HPP
+#define UTILS_TRACE_HPP
+
+#include "queue.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Binary pipeline trace.
+ *
+ * Layout (raw structs in host byte order, so a trace is only portable
+ * between hosts of the same endianness):
+ *   TraceHeader
+ *   TraceRecord until the end of the file, in the order they were recorded
+ *
+ * The meaning of TraceRecord::value depends on the event:
+ *   Fetch, Issue, Dispatch   unused (0)
+ *   Broadcast                the result put on the CDB
+ *   Commit                   the value written to the destination register
+ *   Flush                    the PC fetch restarts from
+ *   MemStart                 the effective address (store buffer: the block)
+ *   MemFinish                the loaded data (store buffer: the block)
+ *   Redirect                 how many of the youngest fetch buffer entries
+ *                            were discarded; pc is where fetch restarts
+ */
+constexpr std::array<char, 8> TRACE_MAGIC = {'R', 'V', 'S', 'I',
+                                             'M', 'T', 'R', 'C'};
+constexpr uint32_t TRACE_VERSION = 2;
+constexpr uint32_t TRACE_NO_ROB = UINT32_MAX; // not (or no longer) in the ROB
+
+enum class TraceEvent : uint8_t {
+  Fetch,
+  Issue,
+  Dispatch,
+  Broadcast,
+  Commit,
+  Flush,
+  MemStart,
+  MemFinish,
+  Redirect,
+  Count
+};
+
+// Functional unit an instruction is dispatched to or broadcasts from.
+enum class TraceUnit : uint8_t {
+  None,
+  ALU,
+  Branch,
+  Memory,
+  StoreBuffer,
+  Count
+};
+
+struct TraceHeader {
+  std::array<char, 8> magic;
+  uint32_t version;
+  uint32_t record_size;
+};
+
+struct TraceRecord {
+  uint64_t cycle;
+  uint32_t rob_id;
+  uint32_t pc;
+  uint32_t value;
+  TraceEvent event;
+  TraceUnit unit;
+  uint16_t reserved;
+};
+
+static_assert(sizeof(TraceHeader) == 16, "TraceHeader layout changed");
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord layout changed");
+
+inline const char *trace_event_name(TraceEvent event) {
+  static constexpr const char *NAMES[] = {
+      "fetch",  "issue", "dispatch",  "broadcast", "commit",
+      "flush",  "mem-start", "mem-finish", "redirect"};
+  return event < TraceEvent::Count ? NAMES[static_cast<int>(event)] : "?";
+}
+
+inline const char *trace_unit_name(TraceUnit unit) {
+  static constexpr const char *NAMES[] = {"-", "alu", "branch", "lsb",
+                                          "store-buffer"};
+  return unit < TraceUnit::Count ? NAMES[static_cast<int>(unit)] : "?";
+}
+
+/**
+ * @brief Records trace events into an SPSCQueue that a background thread
+ * drains to a file. When the writer falls a full queue behind, record() waits
+ * for it rather than dropping events.
+ */
+class TraceWriter {
+  static constexpr size_t QUEUE_SIZE = 1 << 16; // records, a power of two
+
+  SPSCQueue<TraceRecord> queue;
+  uint64_t cycle = 0;
+  uint64_t recorded = 0;
+  uint64_t full_waits = 0;
+  std::atomic<bool> stopping{false};
+  std::FILE *file;
+  bool write_failed = false; // owned by the writer thread until joined
+  bool closed = false;
+  std::thread writer;
+
+  void drain();
+
+public:
+  /**
+   * @brief Creates the trace file and starts the writer thread.
+   * @throws std::runtime_error if the file cannot be created.
+   */
+  explicit TraceWriter(const std::string &path);
+  ~TraceWriter() { close(); }
+
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+
+  void set_cycle(uint64_t value) { cycle = value; }
+
+  void record(TraceEvent event, uint32_t rob_id, uint32_t pc,
+              uint32_t value = 0, TraceUnit unit = TraceUnit::None) {
+    TraceRecord record{cycle, rob_id, pc, value, event, unit, 0};
+    if (!queue.try_push(record)) {
+      full_waits++;
+      do {
+        std::this_thread::yield();
+      } while (!queue.try_push(record));
+    }
+    recorded++;
+  }
+
+  /**
+   * @brief Writes out every recorded event and closes the file.
+   * @return false if any write failed.
+   */
+  bool close();
+
+  void print_stats(std::ostream &os) const {
+    os << "Trace: " << recorded << " events  writer stalls " << full_waits << "\n";
+  }
+};
+
+inline TraceWriter::TraceWriter(const std::string &path)
+    : queue(QUEUE_SIZE), file(std::fopen(path.c_str(), "wb")) {
+  if (!file) {
+    throw std::runtime_error("Could not open trace file for writing: " + path);
+  }
+  TraceHeader header{};
+  header.magic = TRACE_MAGIC;
+  header.version = TRACE_VERSION;
+  header.record_size = sizeof(TraceRecord);
+  if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+    std::fclose(file);
+    throw std::runtime_error("Failed to write trace file: " + path);
+  }
+  writer = std::thread(&TraceWriter::drain, this);
+}
+
+/**
+ * @brief Writer thread: copies queued records to the file in contiguous
+ * runs, polling while the queue is empty.
+ */
+inline void TraceWriter::drain() {
+  auto write = [this](const TraceRecord *records, size_t count) {
+    if (std::fwrite(records, sizeof(TraceRecord), count, file) != count) {
+      write_failed = true;
+    }
+  };
+  while (true) {
+    // every record is queued before stopping is set
+    bool stop = stopping.load(std::memory_order_acquire);
+    if (queue.pop_run(write) > 0) {
+      continue;
+    }
+    if (stop) {
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+}
+
+inline bool TraceWriter::close() {
+  if (closed) {
+    return !write_failed;
+  }
+  closed = true;
+  stopping.store(true, std::memory_order_release);
+  writer.join();
+  if (std::fclose(file) != 0) {
+    write_failed = true;
+  }
+  return !write_failed;
+}
+
+/**
+ * @brief Calls visit(const TraceRecord &) for every record of a trace file,
+ * in recording order.
+ * @throws std::runtime_error if the file is missing, not a trace, or cannot
+ * be read.
+ */
+template <typename Visitor>
+void read_trace(const std::string &path, Visitor visit) {
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    throw std::runtime_error("Could not open trace file: " + path);
+  }
+  TraceHeader header;
+  if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != TRACE_MAGIC) {
+    std::fclose(file);
+    throw std::runtime_error("Not a pipeline trace: " + path);
+  }
+  if (header.version != TRACE_VERSION ||
+      header.record_size != sizeof(TraceRecord)) {
+    std::fclose(file);
+    throw std::runtime_error("Unsupported trace version: " +
+                             std::to_string(header.version));
+  }
+
+  std::vector<TraceRecord> records(4096);
+  size_t count;
+  while ((count = std::fread(records.data(), sizeof(TraceRecord),
+                             records.size(), file)) > 0) {
+    for (size_t i = 0; i < count; i++) {
+      visit(records[i]);
+    }
+  }
+  bool failed = std::ferror(file) != 0;
+  std::fclose(file);
+  if (failed) {
+    throw std::runtime_error("Failed to read trace file: " + path);
+  }
+}
+
+/**
+ * @brief Prints a trace file as aligned text, or as CSV with a header row.
+ * @throws std::runtime_error as read_trace().
+ */
+inline void decode_trace(const std::string &path, std::ostream &os,
+                         bool csv) {
+  if (csv) {
+    os << "cycle,event,rob,pc,unit,value\n";
+  }
+  read_trace(path, [&](const TraceRecord &r) {
+    std::string rob = r.rob_id == TRACE_NO_ROB ? "-" : std::to_string(r.rob_id);
+    if (csv) {
+      os << r.cycle << ',' << trace_event_name(r.event) << ',' << rob << ",0x"
+         << std::hex << std::setw(8) << std::setfill('0') << r.pc << std::dec
+         << ',' << trace_unit_name(r.unit) << ',' << r.value << '\n';
+    } else {
+      os << std::setw(10) << std::setfill(' ') << r.cycle << "  " << std::left
+         << std::setw(10) << trace_event_name(r.event) << " rob "
+         << std::setw(4) << rob << std::right << " pc 0x" << std::hex
+         << std::setw(8) << std::setfill('0') << r.pc << std::dec
+         << std::setfill(' ') << "  " << std::left << std::setw(12)
+         << trace_unit_name(r.unit) << std::right << ' ' << r.value << '\n';
+    }
+  });
+}
+
+#endif // UTILS_TRACE_HPP